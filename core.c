@@ -195,6 +195,8 @@ static int mwl_init_firmware(struct mwl_priv *priv, const char *fw_name,
 		goto err_download_fw;
 	}
 
+	mwl_fwcmd_shadow_invalidate(priv->hw);
+
 	if (cal_name) {
 		if ((request_firmware((const struct firmware **)&priv->cal_data,
 		     cal_name, priv->dev)) < 0)
@@ -677,25 +679,26 @@ static void mwl_wds_check_handle(struct work_struct *work)
 		container_of(work, struct mwl_priv, wds_check_handle);
 	struct mwl_sta *sta_info;
 	struct ieee80211_sta *sta;
+	u8 addr[ETH_ALEN];
 	bool wds_sta = false;
 
-	spin_lock_bh(&priv->sta_lock);
-	list_for_each_entry(sta_info, &priv->sta_list, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta_info, &priv->sta_list, list) {
 		if (sta_info->wds)
 			continue;
 		sta = container_of((void *)sta_info, struct ieee80211_sta,
 				   drv_priv);
 		if (ether_addr_equal(sta->addr, priv->wds_check_sta)) {
+			ether_addr_copy(addr, sta->addr);
+			sta_info->wds = true;
 			wds_sta = true;
 			break;
 		}
 	}
-	spin_unlock_bh(&priv->sta_lock);
+	rcu_read_unlock();
 
-	if (wds_sta) {
-		mwl_fwcmd_set_new_stn_wds_sc4(priv->hw, sta->addr);
-		sta_info->wds = true;
-	}
+	if (wds_sta)
+		mwl_fwcmd_set_new_stn_wds_sc4(priv->hw, addr);
 
 	priv->wds_check = false;
 }
@@ -713,15 +716,15 @@ static void mwl_chnl_switch_event(struct work_struct *work)
 		return;
 	}
 
-	spin_lock_bh(&priv->vif_lock);
-	list_for_each_entry(mwl_vif, &priv->vif_list, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(mwl_vif, &priv->vif_list, list) {
 		vif = container_of((void *)mwl_vif, struct ieee80211_vif,
 				   drv_priv);
 
 		if (vif->csa_active)
 			ieee80211_csa_finish(vif);
 	}
-	spin_unlock_bh(&priv->vif_lock);
+	rcu_read_unlock();
 
 	wiphy_info(priv->hw->wiphy, "channel switch is done\n");
 
@@ -787,6 +790,21 @@ static int mwl_wl_init(struct mwl_priv *priv)
 	ieee80211_hw_set(hw, SUPPORTS_PER_STA_GTK);
 	ieee80211_hw_set(hw, MFP_CAPABLE);
 
+	/* New data path firmware builds the 802.11 header itself and hands
+	 * fast data frames up as DA/SA plus SNAP.
+	 */
+	if (priv->chip_type == MWL8964) {
+		ieee80211_hw_set(hw, SUPPORTS_TX_ENCAP_OFFLOAD);
+		ieee80211_hw_set(hw, SUPPORTS_RX_DECAP_OFFLOAD);
+	}
+
+	/* Only new data path firmware reports airtime, through the
+	 * accounting ring.
+	 */
+	if (priv->chip_type == MWL8964)
+		wiphy_ext_feature_set(hw->wiphy,
+				      NL80211_EXT_FEATURE_AIRTIME_FAIRNESS);
+
 	hw->wiphy->flags |= WIPHY_FLAG_IBSS_RSN;
 	hw->wiphy->flags |= WIPHY_FLAG_HAS_CHANNEL_SWITCH;
 	hw->wiphy->flags |= WIPHY_FLAG_SUPPORTS_TDLS;
@@ -797,12 +815,14 @@ static int mwl_wl_init(struct mwl_priv *priv)
 
 	hw->vif_data_size = sizeof(struct mwl_vif);
 	hw->sta_data_size = sizeof(struct mwl_sta);
+	hw->txq_data_size = sizeof(struct mwl_txq);
 
 	priv->ap_macids_supported = 0x0000ffff;
 	priv->sta_macids_supported = 0x00010000;
 	priv->macids_used = 0;
 	INIT_LIST_HEAD(&priv->vif_list);
 	INIT_LIST_HEAD(&priv->sta_list);
+	hash_init(priv->sta_hash);
 
 	/* Set default radio state, preamble and wmm */
 	priv->noise = -104;
@@ -1050,7 +1070,8 @@ struct ieee80211_hw *mwl_alloc_hw(int bus_type,
 		pr_err("alloc stnid failed\n");
 		return NULL;
 	}
-	priv->available_stnid = 0;
+	priv->stnid_next = 0;
+	priv->stnid_used = 0;
 
 	SET_IEEE80211_DEV(hw, dev);
 
@@ -21,6 +21,7 @@
 #include <linux/interrupt.h>
 #include <linux/firmware.h>
 #include <linux/of.h>
+#include <linux/hashtable.h>
 #include <net/mac80211.h>
 
 #include "hif/hif.h"
@@ -44,6 +45,9 @@
 
 #define NUM_WEP_KEYS                  4
 #define MWL_MAX_TID                   8
+#define MWL_STA_HASH_BITS             6
+#define MWL_MACID_NUM                 (SYSADPT_NUM_OF_AP + \
+				       SYSADPT_NUM_OF_CLIENT)
 #define MWL_AMSDU_SIZE_4K             1
 #define MWL_AMSDU_SIZE_8K             2
 #define MWL_AMSDU_SIZE_11K            3
@@ -196,6 +200,11 @@ struct mwl_stnid {
 	u16 aid;                    /* keep aid for related stnid   */
 };
 
+struct mwl_stnid_range {
+	u16 start;                  /* first reserved stnid         */
+	u16 num;                    /* 0: no reservation            */
+};
+
 struct otp_data {
 	u8 buf[SYSADPT_OTP_BUF_SIZE];
 	u32 len; /* Actual size of data in buf[] */
@@ -206,6 +215,69 @@ struct txpwrlmt_cfg_data {
 	u32 len; /* Actual size of data in buf[] */
 };
 
+struct mwl_amsdu_stats {
+	u32 aggr;                    /* A-MSDUs built                */
+	u32 msdus;                   /* MSDUs put into A-MSDUs       */
+	u64 bytes;                   /* MSDU payload bytes           */
+	u64 copy_bytes;              /* bytes copied to build them   */
+};
+
+#define MWL_CMD_LATENCY_ENTRIES 64
+
+/* Values firmware last acknowledged for idempotent configuration commands,
+ * so that unchanged settings are not sent again. Protected by fwcmd_mutex.
+ */
+#define MWL_SHADOW_APMODE             BIT(0)
+#define MWL_SHADOW_CS_MODE            BIT(1)
+#define MWL_SHADOW_FIXED_RATE         BIT(2)
+#define MWL_SHADOW_CDD                BIT(3)
+
+struct mwl_shadow_tx_power {
+	bool valid;
+	u16 ch;
+	u16 band;
+	u16 width;
+	u16 sub_ch;
+	u16 pow[SYSADPT_TX_GRP_PWR_LEVEL_TOTAL];
+};
+
+/* Fully computed HOSTCMD_CMD_802_11_TX_POWER set payload */
+struct mwl_pwr_payload {
+	u8 action;
+	u16 ch;
+	u16 band;
+	u16 width;
+	u16 sub_ch;
+	u16 pow[SYSADPT_TX_GRP_PWR_LEVEL_TOTAL];
+};
+
+struct mwl_chan_switch_stats {
+	u32 cnt;
+	u32 last_us;
+	u32 max_us;
+	u64 total_us;
+};
+
+struct mwl_fwcmd_shadow {
+	u32 valid;
+	u8 apmode;
+	u16 cs_mode;
+	int mcast_rate;
+	int mgmt_rate;
+	u32 cdd;
+	/* indexed by the HOSTCMD_CMD_802_11_TX_POWER set action */
+	struct mwl_shadow_tx_power tx_power[4];
+	u32 hits;
+};
+
+struct mwl_cmd_latency {
+	u16 cmd;                     /* host command code            */
+	u32 cnt;                     /* commands completed           */
+	u32 irq_cnt;                 /* completed by OPC_DONE irq    */
+	u32 max_us;
+	u64 total_us;
+};
+
 struct mwl_priv {
 	struct ieee80211_hw *hw;
 	struct device *dev;
@@ -239,6 +311,8 @@ struct mwl_priv {
 	int antenna_tx;
 	int antenna_rx;
 	bool tx_amsdu;
+	bool tx_amsdu_zc;
+	struct mwl_amsdu_stats amsdu_stats;
 	bool dump_hostcmd;
 
 	struct mwl_tx_pwr_tbl tx_pwr_tbl[SYSADPT_MAX_NUM_CHANNELS];
@@ -248,12 +322,15 @@ struct mwl_priv {
 	u8 pwr_level;
 	u16 max_tx_pow[SYSADPT_TX_GRP_PWR_LEVEL_TOTAL]; /* max tx power (dBm) */
 	u16 target_powers[SYSADPT_TX_GRP_PWR_LEVEL_TOTAL]; /* target powers   */
+	struct mwl_chan_switch_stats chan_switch_stats;
 
 	struct mutex fwcmd_mutex;    /* for firmware command         */
 	unsigned short *pcmd_buf;    /* pointer to CmdBuf (virtual)  */
 	dma_addr_t pphys_cmd_buf;    /* pointer to CmdBuf (physical) */
 	bool in_send_cmd;
 	bool cmd_timeout;
+	struct mwl_cmd_latency cmd_latency[MWL_CMD_LATENCY_ENTRIES];
+	struct mwl_fwcmd_shadow fwcmd_shadow;
 	bool rmmod;
 	int heartbeat;
 	unsigned long jiffies_ampdu;
@@ -294,6 +371,9 @@ struct mwl_priv {
 	struct {
 		spinlock_t sta_lock;         /* for private sta info        */
 		struct list_head sta_list;   /* List of stations            */
+		/* RCU lookups, updated under sta_lock */
+		DECLARE_HASHTABLE(sta_hash, MWL_STA_HASH_BITS);
+		struct mwl_sta __rcu *sta_by_id[SYSADPT_MAX_STA_SC4 + 1];
 	} ____cacheline_aligned_in_smp;
 
 	/* ampdu stream information */
@@ -310,7 +390,14 @@ struct mwl_priv {
 	struct {
 		spinlock_t stnid_lock;      /* for station id              */
 		struct mwl_stnid *stnid;
-		u16 available_stnid;
+		/* bit n is stnid n + 1 */
+		DECLARE_BITMAP(stnid_map, SYSADPT_MAX_STA_SC4);
+		DECLARE_BITMAP(stnid_reserved, SYSADPT_MAX_STA_SC4);
+		/* stnid_map | stnid_reserved, searched for shared ids */
+		DECLARE_BITMAP(stnid_busy, SYSADPT_MAX_STA_SC4);
+		struct mwl_stnid_range stnid_range[MWL_MACID_NUM];
+		u16 stnid_next;
+		u16 stnid_used;
 	} ____cacheline_aligned_in_smp;
 
 	bool radio_on;
@@ -421,8 +508,12 @@ struct mwl_tx_info {
 
 struct mwl_amsdu_frag {
 	struct sk_buff *skb;
+	struct sk_buff *tail; /* last MSDU chained on skb (zero copy) */
 	u8 pad;
 	u8 num;
+	bool zc;
+	struct list_head list;       /* on the hif pending A-MSDU list */
+	struct mwl_sta *sta_info;    /* owner of this frag             */
 };
 
 struct mwl_amsdu_ctrl {
@@ -466,6 +557,7 @@ struct mwl_tx_hist {
 
 struct mwl_sta {
 	struct list_head list;
+	struct hlist_node hash;
 	struct mwl_vif *mwl_vif;
 	u16 stnid;
 	u16 sta_stnid;
@@ -474,9 +566,14 @@ struct mwl_sta {
 	bool is_ampdu_allowed;
 	struct mwl_tx_info tx_stats[MWL_MAX_TID];
 	u32 check_ba_failed[MWL_MAX_TID];
+	/* tx ampdu stream per tid, updated under priv->stream_lock */
+	struct mwl_ampdu_stream *ampdu[MWL_MAX_TID];
+	/* idx + 1 of the active stream per tid, 0 if none; read locklessly */
+	u16 ampdu_txq[MWL_MAX_TID];
 	struct mwl_tx_ba_hist ba_hist;
 	bool is_amsdu_allowed;
 	bool is_key_set;
+	bool rx_decap;
 	/* for amsdu aggregation */
 	struct {
 		spinlock_t amsdu_lock;   /* for amsdu */
@@ -490,6 +587,15 @@ struct mwl_sta {
 	u16 rx_gi;
 	u16 rx_rate_mcs;
 	u8 rx_signal;
+	/* airtime queued to firmware and not yet accounted, in usec */
+	u32 aql_pending;
+	u32 aql_pending_pkts;
+	u32 aql_pkt_airtime;
+	unsigned long aql_jiffies;
+};
+
+struct mwl_txq {
+	int deficit;                /* bytes left in this DRR round */
 };
 
 static inline struct mwl_vif *mwl_dev_get_vif(const struct ieee80211_vif *vif)
@@ -502,6 +608,11 @@ static inline struct mwl_sta *mwl_dev_get_sta(const struct ieee80211_sta *sta)
 	return (struct mwl_sta *)&sta->drv_priv;
 }
 
+static inline struct mwl_txq *mwl_dev_get_txq(const struct ieee80211_txq *txq)
+{
+	return (struct mwl_txq *)&txq->drv_priv;
+}
+
 struct ieee80211_hw *mwl_alloc_hw(int bus_type,
 				  int chip_type,
 				  struct device *dev,
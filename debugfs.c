@@ -412,6 +412,10 @@ err_get_hw_specs:
 	len += scnprintf(p + len, size - len, "antenna: %d %d\n",
 			 tx_num, rx_num);
 	len += scnprintf(p + len, size - len, "irq number: %d\n", priv->irq);
+	if (priv->hif.bus == MWL_BUS_PCIE)
+		len += scnprintf(p + len, size - len, "irq mode: %s\n",
+				 to_pci_dev(priv->dev)->msi_enabled ?
+				 "MSI" : "INTx");
 	len += scnprintf(p + len, size - len, "ap macid support: %08x\n",
 			 priv->ap_macids_supported);
 	len += scnprintf(p + len, size - len, "sta macid support: %08x\n",
@@ -541,8 +545,8 @@ static ssize_t mwl_debugfs_vif_read(struct file *file, char __user *ubuf,
 	if (!p)
 		return -ENOMEM;
 
-	spin_lock_bh(&priv->vif_lock);
-	list_for_each_entry(mwl_vif, &priv->vif_list, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(mwl_vif, &priv->vif_list, list) {
 		vif = container_of((void *)mwl_vif, struct ieee80211_vif,
 				   drv_priv);
 		len += scnprintf(p + len, size - len,
@@ -611,7 +615,7 @@ static ssize_t mwl_debugfs_vif_read(struct file *file, char __user *ubuf,
 				  beacon_info->ie_meshchsw_len, "MESHCHSW:");
 		}
 	}
-	spin_unlock_bh(&priv->vif_lock);
+	rcu_read_unlock();
 
 	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
 	free_page(page);
@@ -635,8 +639,8 @@ static ssize_t mwl_debugfs_sta_read(struct file *file, char __user *ubuf,
 
 	len += scnprintf(p + len, size - len, "       macaddress|aid|ampdu|amsdu|  wds|ba_hist|amsdu_cap|  ht cap, ampdu,         rx_mask|   vht_cap|           mcs|rx bw,nss|tdls|init|wme|mfp\n");
 
-	spin_lock_bh(&priv->sta_lock);
-	list_for_each_entry(sta_info, &priv->sta_list, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta_info, &priv->sta_list, list) {
 		sta = container_of((void *)sta_info, struct ieee80211_sta,
 				   drv_priv);
 
@@ -666,7 +670,7 @@ static ssize_t mwl_debugfs_sta_read(struct file *file, char __user *ubuf,
 			sta->mfp
 			);
 	}
-	spin_unlock_bh(&priv->sta_lock);
+	rcu_read_unlock();
 
 	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
 	free_page(page);
@@ -720,8 +724,8 @@ static ssize_t mwl_debugfs_ampdu_read(struct file *file, char __user *ubuf,
 		}
 	}
 	spin_unlock_bh(&priv->stream_lock);
-	spin_lock_bh(&priv->sta_lock);
-	list_for_each_entry(sta_info, &priv->sta_list, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta_info, &priv->sta_list, list) {
 		for (i = 0; i < MWL_MAX_TID; i++) {
 			if (sta_info->check_ba_failed[i]) {
 				sta = container_of((void *)sta_info,
@@ -734,7 +738,7 @@ static ssize_t mwl_debugfs_ampdu_read(struct file *file, char __user *ubuf,
 			}
 		}
 	}
-	spin_unlock_bh(&priv->sta_lock);
+	rcu_read_unlock();
 
 	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
 	free_page(page);
@@ -783,17 +787,29 @@ static ssize_t mwl_debugfs_stnid_read(struct file *file, char __user *ubuf,
 	char *p = (char *)page;
 	int len = 0, size = PAGE_SIZE;
 	struct mwl_stnid *stnid;
-	int i;
+	struct mwl_stnid_range *range;
+	unsigned int i;
 	ssize_t ret;
 
 	if (!p)
 		return -ENOMEM;
 
 	spin_lock_bh(&priv->stnid_lock);
-	for (i = 0; i < priv->stnid_num; i++) {
-		stnid = &priv->stnid[i];
-		if (!stnid->aid)
+	len += scnprintf(p + len, size - len,
+			 "used: %u/%d reserved: %u next: %u\n",
+			 priv->stnid_used, priv->stnid_num,
+			 bitmap_weight(priv->stnid_reserved, priv->stnid_num),
+			 priv->stnid_next + 1);
+	for (i = 0; i < MWL_MACID_NUM; i++) {
+		range = &priv->stnid_range[i];
+		if (!range->num)
 			continue;
+		len += scnprintf(p + len, size - len,
+				 "macid: %u reserved stnid: %u-%u\n", i,
+				 range->start, range->start + range->num - 1);
+	}
+	for_each_set_bit(i, priv->stnid_map, priv->stnid_num) {
+		stnid = &priv->stnid[i];
 		len += scnprintf(p + len, size - len,
 				 "stnid: %d macid: %d aid: %d\n",
 				 i + 1, stnid->macid, stnid->aid);
@@ -806,6 +822,42 @@ static ssize_t mwl_debugfs_stnid_read(struct file *file, char __user *ubuf,
 	return ret;
 }
 
+static ssize_t mwl_debugfs_stnid_write(struct file *file,
+				       const char __user *ubuf,
+				       size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+	unsigned long addr = get_zeroed_page(GFP_KERNEL);
+	char *buf = (char *)addr;
+	size_t buf_size = min_t(size_t, count, PAGE_SIZE - 1);
+	int macid;
+	u16 start = 0, num = 0;
+	ssize_t ret;
+
+	if (!buf)
+		return -ENOMEM;
+
+	if (copy_from_user(buf, ubuf, buf_size)) {
+		ret = -EFAULT;
+		goto err;
+	}
+
+	/* "<macid> <first stnid> <count>" reserves, "<macid>" releases */
+	ret = sscanf(buf, "%d %hu %hu", &macid, &start, &num);
+	if ((ret != 1) && (ret != 3)) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	ret = utils_reserve_stnid(priv, macid, start, num);
+	if (!ret)
+		ret = count;
+
+err:
+	free_page(addr);
+	return ret;
+}
+
 static ssize_t mwl_debugfs_device_pwrtbl_read(struct file *file,
 					      char __user *ubuf,
 					      size_t count, loff_t *ppos)
@@ -913,6 +965,245 @@ err:
 	return ret;
 }
 
+static ssize_t mwl_debugfs_tx_amsdu_zc_read(struct file *file,
+					    char __user *ubuf,
+					    size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+	unsigned long page = get_zeroed_page(GFP_KERNEL);
+	char *p = (char *)page;
+	int len = 0, size = PAGE_SIZE;
+	ssize_t ret;
+
+	if (!p)
+		return -ENOMEM;
+
+	len += scnprintf(p + len, size - len, "tx amsdu zero copy: %s\n",
+			 priv->tx_amsdu_zc ? "enable" : "disable");
+	len += scnprintf(p + len, size - len, "aggregates: %u\n",
+			 priv->amsdu_stats.aggr);
+	len += scnprintf(p + len, size - len, "msdus: %u\n",
+			 priv->amsdu_stats.msdus);
+	len += scnprintf(p + len, size - len, "bytes: %llu\n",
+			 priv->amsdu_stats.bytes);
+	len += scnprintf(p + len, size - len, "copied bytes: %llu\n",
+			 priv->amsdu_stats.copy_bytes);
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
+	free_page(page);
+
+	return ret;
+}
+
+static ssize_t mwl_debugfs_tx_amsdu_zc_write(struct file *file,
+					     const char __user *ubuf,
+					     size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+	unsigned long addr = get_zeroed_page(GFP_KERNEL);
+	char *buf = (char *)addr;
+	size_t buf_size = min_t(size_t, count, PAGE_SIZE - 1);
+	int value;
+	ssize_t ret;
+
+	if (!buf)
+		return -ENOMEM;
+
+	if (copy_from_user(buf, ubuf, buf_size)) {
+		ret = -EFAULT;
+		goto err;
+	}
+
+	if (kstrtoint(buf, 0, &value)) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	/* Only the 88W8997 TXBD ring can gather an A-MSDU from pieces. */
+	if (value && priv->chip_type != MWL8997) {
+		ret = -EOPNOTSUPP;
+		goto err;
+	}
+
+	priv->tx_amsdu_zc = value ? true : false;
+	memset(&priv->amsdu_stats, 0, sizeof(priv->amsdu_stats));
+
+	ret = count;
+
+err:
+	free_page(addr);
+	return ret;
+}
+
+static ssize_t mwl_debugfs_cmd_latency_read(struct file *file,
+					    char __user *ubuf,
+					    size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+	unsigned long page = get_zeroed_page(GFP_KERNEL);
+	char *p = (char *)page;
+	int len = 0, size = PAGE_SIZE;
+	struct mwl_cmd_latency *lat;
+	ssize_t ret;
+	int i;
+
+	if (!p)
+		return -ENOMEM;
+
+	len += scnprintf(p + len, size - len, "skipped as unchanged: %u\n",
+			 priv->fwcmd_shadow.hits);
+	len += scnprintf(p + len, size - len,
+			 "cmd    count      irq        avg(us)  max(us)  name\n");
+	mutex_lock(&priv->fwcmd_mutex);
+	for (i = 0; i < MWL_CMD_LATENCY_ENTRIES; i++) {
+		lat = &priv->cmd_latency[i];
+		if (!lat->cnt)
+			break;
+		len += scnprintf(p + len, size - len,
+				 "0x%04x %-10u %-10u %-8llu %-8u %s\n",
+				 lat->cmd, lat->cnt, lat->irq_cnt,
+				 div_u64(lat->total_us, lat->cnt),
+				 lat->max_us,
+				 mwl_fwcmd_get_cmd_string(lat->cmd));
+	}
+	mutex_unlock(&priv->fwcmd_mutex);
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
+	free_page(page);
+
+	return ret;
+}
+
+static ssize_t mwl_debugfs_cmd_latency_write(struct file *file,
+					     const char __user *ubuf,
+					     size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+
+	mutex_lock(&priv->fwcmd_mutex);
+	memset(priv->cmd_latency, 0, sizeof(priv->cmd_latency));
+	priv->fwcmd_shadow.hits = 0;
+	mutex_unlock(&priv->fwcmd_mutex);
+
+	return count;
+}
+
+static ssize_t mwl_debugfs_chan_switch_read(struct file *file,
+					    char __user *ubuf,
+					    size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+	struct mwl_chan_switch_stats *stats = &priv->chan_switch_stats;
+	unsigned long page = get_zeroed_page(GFP_KERNEL);
+	char *p = (char *)page;
+	int len = 0, size = PAGE_SIZE;
+	ssize_t ret;
+
+	if (!p)
+		return -ENOMEM;
+
+	len += scnprintf(p + len, size - len, "switches: %u\n", stats->cnt);
+	len += scnprintf(p + len, size - len, "last switch (us): %u\n",
+			 stats->last_us);
+	len += scnprintf(p + len, size - len, "avg switch (us): %llu\n",
+			 stats->cnt ? div_u64(stats->total_us, stats->cnt) : 0);
+	len += scnprintf(p + len, size - len, "max switch (us): %u\n",
+			 stats->max_us);
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
+	free_page(page);
+
+	return ret;
+}
+
+static ssize_t mwl_debugfs_chan_switch_write(struct file *file,
+					     const char __user *ubuf,
+					     size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+
+	memset(&priv->chan_switch_stats, 0, sizeof(priv->chan_switch_stats));
+
+	return count;
+}
+
+static ssize_t mwl_debugfs_irq_moderation_read(struct file *file,
+					       char __user *ubuf,
+					       size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct pcie_irq_mod *mod = &pcie_priv->irq_mod;
+	static const char * const mode_str[] = {
+		"off", "static", "adaptive"
+	};
+	unsigned long page = get_zeroed_page(GFP_KERNEL);
+	char *p = (char *)page;
+	int len = 0, size = PAGE_SIZE;
+	ssize_t ret;
+
+	if (!p)
+		return -ENOMEM;
+
+	len += scnprintf(p + len, size - len, "mode: %d (%s)\n",
+			 mod->mode, mode_str[mod->mode]);
+	len += scnprintf(p + len, size - len, "static delay (us): %u\n",
+			 mod->static_usec);
+	len += scnprintf(p + len, size - len, "current delay (us): %u\n",
+			 READ_ONCE(mod->usec));
+	len += scnprintf(p + len, size - len, "dim profile: %u\n",
+			 mod->dim.profile_ix);
+	len += scnprintf(p + len, size - len, "rx packets: %llu\n",
+			 mod->pkts);
+	len += scnprintf(p + len, size - len, "rearm: %u\n", mod->rearm);
+	len += scnprintf(p + len, size - len, "rearm deferred: %u\n",
+			 mod->deferred);
+	len += scnprintf(p + len, size - len,
+			 "write \"<mode> [usec]\": 0 off, 1 static, 2 adaptive\n");
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
+	free_page(page);
+
+	return ret;
+}
+
+static ssize_t mwl_debugfs_irq_moderation_write(struct file *file,
+						const char __user *ubuf,
+						size_t count, loff_t *ppos)
+{
+	struct mwl_priv *priv = (struct mwl_priv *)file->private_data;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	unsigned long addr = get_zeroed_page(GFP_KERNEL);
+	char *buf = (char *)addr;
+	size_t buf_size = min_t(size_t, count, PAGE_SIZE - 1);
+	int mode;
+	u32 usec = 0;
+	ssize_t ret;
+
+	if (!buf)
+		return -ENOMEM;
+
+	if (copy_from_user(buf, ubuf, buf_size)) {
+		ret = -EFAULT;
+		goto err;
+	}
+
+	ret = sscanf(buf, "%d %u", &mode, &usec);
+	if ((ret < 1) || (mode < PCIE_IRQ_MOD_OFF) ||
+	    (mode > PCIE_IRQ_MOD_ADAPTIVE) ||
+	    ((mode == PCIE_IRQ_MOD_STATIC) && (ret != 2))) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	pcie_irq_mod_set(pcie_priv, mode, usec);
+	ret = count;
+
+err:
+	free_page(addr);
+	return ret;
+}
+
 static ssize_t mwl_debugfs_dump_hostcmd_read(struct file *file,
 					     char __user *ubuf,
 					     size_t count, loff_t *ppos)
@@ -1466,8 +1757,8 @@ static ssize_t mwl_debugfs_ratetable_read(struct file *file, char __user *ubuf,
 		goto err;
 	}
 
-	spin_lock_bh(&priv->sta_lock);
-	list_for_each_entry(sta_info, &priv->sta_list, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta_info, &priv->sta_list, list) {
 		sta = container_of((void *)sta_info, struct ieee80211_sta,
 				   drv_priv);
 		if (priv->ra_aid == sta->aid) {
@@ -1475,7 +1766,7 @@ static ssize_t mwl_debugfs_ratetable_read(struct file *file, char __user *ubuf,
 			break;
 		}
 	}
-	spin_unlock_bh(&priv->sta_lock);
+	rcu_read_unlock();
 
 	rate_table = kzalloc(size, GFP_KERNEL);
 	if (!rate_table) {
@@ -1627,8 +1918,8 @@ static ssize_t mwl_debugfs_tx_hist_read(struct file *file, char __user *ubuf,
 			 priv->ra_tx_attempt[MU_MIMO][3],
 			 priv->ra_tx_attempt[MU_MIMO][4],
 			 priv->ra_tx_attempt[MU_MIMO][5]);
-	spin_lock_bh(&priv->sta_lock);
-	list_for_each_entry(sta_info, &priv->sta_list, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta_info, &priv->sta_list, list) {
 		sta = container_of((void *)sta_info, struct ieee80211_sta,
 				   drv_priv);
 		len += scnprintf(p + len, size - len, "\nSTA %pM\n", sta->addr);
@@ -1638,7 +1929,7 @@ static ssize_t mwl_debugfs_tx_hist_read(struct file *file, char __user *ubuf,
 		len += scnprintf(p + len, size - len,
 				 "============================\n");
 	}
-	spin_unlock_bh(&priv->sta_lock);
+	rcu_read_unlock();
 
 	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
 	free_page(page);
@@ -1672,12 +1963,14 @@ static ssize_t mwl_debugfs_tx_hist_write(struct file *file,
 
 	if (!reset) {
 		memset(&priv->ra_tx_attempt, 0, 2 * 6 * sizeof(u32));
-		spin_lock_bh(&priv->sta_lock);
-		list_for_each_entry(sta_info, &priv->sta_list, list) {
+		rcu_read_lock();
+		list_for_each_entry_rcu(sta_info, &priv->sta_list, list) {
+			spin_lock_bh(&priv->sta_lock);
 			memset(&sta_info->tx_hist, 0,
 			       sizeof(sta_info->tx_hist));
+			spin_unlock_bh(&priv->sta_lock);
 		}
-		spin_unlock_bh(&priv->sta_lock);
+		rcu_read_unlock();
 	}
 
 	ret = count;
@@ -1695,7 +1988,10 @@ static ssize_t mwl_debugfs_ba_hist_read(struct file *file, char __user *ubuf,
 	char *p = (char *)page;
 	int len = 0, size = PAGE_SIZE;
 	struct mwl_sta *sta_info;
-	struct mwl_tx_ba_stats *ba_stats;
+	struct mwl_tx_ba_stats *ba_stats = NULL;
+	bool found = false;
+	u16 stnid = 0;
+	u8 type = 0;
 	u32 i, data;
 	u32 baholecnt, baexpcnt, bmap0cnt, nobacnt;
 	u8 bmap0flag, nobaflag;
@@ -1712,6 +2008,27 @@ static ssize_t mwl_debugfs_ba_hist_read(struct file *file, char __user *ubuf,
 		goto err;
 	}
 
+	/* work on a copy, the station may go away while the file is written */
+	ba_stats = kmalloc_array(ACNT_BA_SIZE, sizeof(*ba_stats), GFP_KERNEL);
+	if (!ba_stats) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	rcu_read_lock();
+	sta_info = utils_find_sta_by_aid(priv, priv->ba_aid);
+	if (sta_info) {
+		spin_lock_bh(&priv->sta_lock);
+		if (sta_info->ba_hist.enable && sta_info->ba_hist.ba_stats) {
+			memcpy(ba_stats, sta_info->ba_hist.ba_stats,
+			       ACNT_BA_SIZE * sizeof(*ba_stats));
+			stnid = sta_info->stnid;
+			type = sta_info->ba_hist.type;
+			found = true;
+		}
+		spin_unlock_bh(&priv->sta_lock);
+	}
+	rcu_read_unlock();
+
 	memset(buff, 0, sizeof(buff));
 	memset(file_location, 0, sizeof(file_location));
 	sprintf(file_location, "/tmp/ba_histo-%d", priv->ba_aid);
@@ -1724,18 +2041,13 @@ static ssize_t mwl_debugfs_ba_hist_read(struct file *file, char __user *ubuf,
 		goto err;
 	}
 
-	sta_info = utils_find_sta_by_aid(priv, priv->ba_aid);
-	if (sta_info && sta_info->ba_hist.enable &&
-	    sta_info->ba_hist.ba_stats) {
-		ba_stats = sta_info->ba_hist.ba_stats;
+	if (found) {
 		len += scnprintf(p + len, size - len,
 				 "BA histogram aid: %d, stnid: %d type: %s\n",
-				 priv->ba_aid, sta_info->stnid,
-				 sta_info->ba_hist.type ? "MU" : "SU");
+				 priv->ba_aid, stnid, type ? "MU" : "SU");
 		data_p += sprintf(data_p,
 				  "BA histogram aid: %d, stnid: %d type: %s\n",
-				  priv->ba_aid, sta_info->stnid,
-				  sta_info->ba_hist.type ? "MU" : "SU");
+				  priv->ba_aid, stnid, type ? "MU" : "SU");
 		data_p += sprintf(data_p, "%8s,%8s,%8s,%8s\n",
 				  "BAhole", "Expect", "Bmap0", "NoBA");
 		data = *(u32 *)&ba_stats[0];
@@ -1803,6 +2115,7 @@ static ssize_t mwl_debugfs_ba_hist_read(struct file *file, char __user *ubuf,
 	ret = simple_read_from_buffer(ubuf, count, ppos, p, len);
 
 err:
+	kfree(ba_stats);
 	free_page(page);
 	return ret;
 }
@@ -1817,6 +2130,7 @@ static ssize_t mwl_debugfs_ba_hist_write(struct file *file,
 	size_t buf_size = min_t(size_t, count, PAGE_SIZE - 1);
 	int sta_aid;
 	struct mwl_sta *sta_info;
+	struct mwl_tx_ba_stats *old_stats = NULL, *new_stats;
 	int size;
 	ssize_t ret;
 
@@ -1840,27 +2154,39 @@ static ssize_t mwl_debugfs_ba_hist_write(struct file *file,
 		goto err;
 	}
 
+	size = sizeof(struct mwl_tx_ba_stats) * ACNT_BA_SIZE;
+	new_stats = kzalloc(size, GFP_KERNEL);
+
+	rcu_read_lock();
 	if (priv->ba_aid) {
 		sta_info = utils_find_sta_by_aid(priv, priv->ba_aid);
 		if (sta_info) {
+			spin_lock_bh(&priv->sta_lock);
 			sta_info->ba_hist.enable = false;
-			kfree(sta_info->ba_hist.ba_stats);
+			old_stats = sta_info->ba_hist.ba_stats;
+			sta_info->ba_hist.ba_stats = NULL;
+			spin_unlock_bh(&priv->sta_lock);
 		}
 	}
 	priv->ba_aid = 0;
 	sta_info = utils_find_sta_by_aid(priv, sta_aid);
 	if (sta_info) {
-		sta_info->ba_hist.enable = true;
-		sta_info->ba_hist.index = 0;
-		size = sizeof(struct mwl_tx_ba_stats) * ACNT_BA_SIZE;
-		sta_info->ba_hist.ba_stats = kmalloc(size, GFP_KERNEL);
-		if (sta_info->ba_hist.ba_stats) {
-			memset(sta_info->ba_hist.ba_stats, 0, size);
+		if (new_stats) {
+			spin_lock_bh(&priv->sta_lock);
+			sta_info->ba_hist.ba_stats = new_stats;
+			sta_info->ba_hist.index = 0;
+			sta_info->ba_hist.enable = true;
+			spin_unlock_bh(&priv->sta_lock);
+			new_stats = NULL;
 			priv->ba_aid = sta_aid;
 		}
 		ret = count;
 	} else
 		ret = -EINVAL;
+	rcu_read_unlock();
+
+	kfree(old_stats);
+	kfree(new_stats);
 
 err:
 	free_page(addr);
@@ -2152,11 +2478,15 @@ MWLWIFI_DEBUGFS_FILE_READ_OPS(tx_status);
 MWLWIFI_DEBUGFS_FILE_READ_OPS(rx_status);
 MWLWIFI_DEBUGFS_FILE_READ_OPS(vif);
 MWLWIFI_DEBUGFS_FILE_READ_OPS(sta);
-MWLWIFI_DEBUGFS_FILE_READ_OPS(stnid);
 MWLWIFI_DEBUGFS_FILE_READ_OPS(device_pwrtbl);
 MWLWIFI_DEBUGFS_FILE_READ_OPS(txpwrlmt);
 MWLWIFI_DEBUGFS_FILE_OPS(ampdu);
+MWLWIFI_DEBUGFS_FILE_OPS(stnid);
 MWLWIFI_DEBUGFS_FILE_OPS(tx_amsdu);
+MWLWIFI_DEBUGFS_FILE_OPS(tx_amsdu_zc);
+MWLWIFI_DEBUGFS_FILE_OPS(cmd_latency);
+MWLWIFI_DEBUGFS_FILE_OPS(chan_switch);
+MWLWIFI_DEBUGFS_FILE_OPS(irq_moderation);
 MWLWIFI_DEBUGFS_FILE_OPS(rx_decrypt);
 MWLWIFI_DEBUGFS_FILE_OPS(dump_hostcmd);
 MWLWIFI_DEBUGFS_FILE_OPS(heartbeat);
@@ -2196,6 +2526,10 @@ void mwl_debugfs_init(struct ieee80211_hw *hw)
 	MWLWIFI_DEBUGFS_ADD_FILE(device_pwrtbl);
 	MWLWIFI_DEBUGFS_ADD_FILE(txpwrlmt);
 	MWLWIFI_DEBUGFS_ADD_FILE(tx_amsdu);
+	MWLWIFI_DEBUGFS_ADD_FILE(tx_amsdu_zc);
+	MWLWIFI_DEBUGFS_ADD_FILE(cmd_latency);
+	MWLWIFI_DEBUGFS_ADD_FILE(chan_switch);
+	MWLWIFI_DEBUGFS_ADD_FILE(irq_moderation);
 	MWLWIFI_DEBUGFS_ADD_FILE(dump_hostcmd);
 	MWLWIFI_DEBUGFS_ADD_FILE(heartbeat);
 	MWLWIFI_DEBUGFS_ADD_FILE(dfs_test);
@@ -114,13 +114,28 @@ char *mwl_fwcmd_get_cmd_string(unsigned short cmd)
 	return "unknown";
 }
 
+/* Firmware starts from its defaults after a download, so nothing it was
+ * told before can be assumed any more.
+ */
+void mwl_fwcmd_shadow_invalidate(struct ieee80211_hw *hw)
+{
+	struct mwl_priv *priv = hw->priv;
+
+	mutex_lock(&priv->fwcmd_mutex);
+	memset(&priv->fwcmd_shadow, 0, sizeof(priv->fwcmd_shadow));
+	priv->radio_on = false;
+	mutex_unlock(&priv->fwcmd_mutex);
+}
+
 static int mwl_fwcmd_802_11_radio_control(struct mwl_priv *priv,
 					  bool enable, bool force)
 {
 	struct hostcmd_cmd_802_11_radio_control *pcmd;
 
-	if (enable == priv->radio_on && !force)
+	if (enable == priv->radio_on && !force) {
+		priv->fwcmd_shadow.hits++;
 		return 0;
+	}
 
 	pcmd = (struct hostcmd_cmd_802_11_radio_control *)&priv->pcmd_buf[0];
 
@@ -191,12 +206,23 @@ static int mwl_fwcmd_set_tx_powers(struct mwl_priv *priv, u16 txpow[],
 				   u16 width, u16 sub_ch)
 {
 	struct hostcmd_cmd_802_11_tx_power *pcmd;
+	struct mwl_shadow_tx_power *shadow;
+	size_t pow_len = priv->pwr_level * sizeof(txpow[0]);
 	int i;
 
 	pcmd = (struct hostcmd_cmd_802_11_tx_power *)&priv->pcmd_buf[0];
+	shadow = &priv->fwcmd_shadow.tx_power[action];
 
 	mutex_lock(&priv->fwcmd_mutex);
 
+	if (shadow->valid && shadow->ch == ch && shadow->band == band &&
+	    shadow->width == width && shadow->sub_ch == sub_ch &&
+	    !memcmp(shadow->pow, txpow, pow_len)) {
+		priv->fwcmd_shadow.hits++;
+		mutex_unlock(&priv->fwcmd_mutex);
+		return 0;
+	}
+
 	if (priv->chip_type == MWL8997) {
 		memset(pcmd, 0x00,
 		       sizeof(struct hostcmd_cmd_802_11_tx_power_kf2));
@@ -217,10 +243,18 @@ static int mwl_fwcmd_set_tx_powers(struct mwl_priv *priv, u16 txpow[],
 		pcmd->power_level_list[i] = cpu_to_le16(txpow[i]);
 
 	if (mwl_hif_exec_cmd(priv->hw, HOSTCMD_CMD_802_11_TX_POWER)) {
+		shadow->valid = false;
 		mutex_unlock(&priv->fwcmd_mutex);
 		return -EIO;
 	}
 
+	shadow->valid = true;
+	shadow->ch = ch;
+	shadow->band = band;
+	shadow->width = width;
+	shadow->sub_ch = sub_ch;
+	memcpy(shadow->pow, txpow, pow_len);
+
 	mutex_unlock(&priv->fwcmd_mutex);
 
 	return 0;
@@ -1132,97 +1166,113 @@ int mwl_fwcmd_get_addr_value(struct ieee80211_hw *hw, u32 addr, u32 len,
 	return 0;
 }
 
-int mwl_fwcmd_max_tx_power(struct ieee80211_hw *hw,
-			   struct ieee80211_conf *conf, u8 fraction)
+static int mwl_fwcmd_pwr_reduce(u8 fraction)
 {
-	struct ieee80211_channel *channel = conf->chandef.chan;
-	struct mwl_priv *priv = hw->priv;
-	int reduce_val = 0;
-	u16 band = 0, width = 0, sub_ch = 0;
-	u16 maxtxpow[SYSADPT_TX_GRP_PWR_LEVEL_TOTAL];
-	int i, tmp;
-	int rc = 0;
-
-	if ((priv->chip_type != MWL8997) && (priv->forbidden_setting))
-		return rc;
-
 	switch (fraction) {
 	case 0:
-		reduce_val = 0;    /* Max */
-		break;
+		return 0;    /* Max */
 	case 1:
-		reduce_val = 2;    /* 75% -1.25db */
-		break;
+		return 2;    /* 75% -1.25db */
 	case 2:
-		reduce_val = 3;    /* 50% -3db */
-		break;
+		return 3;    /* 50% -3db */
 	case 3:
-		reduce_val = 6;    /* 25% -6db */
-		break;
+		return 6;    /* 25% -6db */
 	default:
 		/* larger than case 3,  pCmd->MaxPowerLevel is min */
-		reduce_val = 0xff;
-		break;
+		return 0xff;
 	}
+}
+
+static int mwl_fwcmd_pwr_chan(struct ieee80211_conf *conf,
+			      struct mwl_pwr_payload *pl)
+{
+	struct ieee80211_channel *channel = conf->chandef.chan;
+
+	pl->ch = channel->hw_value;
 
 	if (channel->band == NL80211_BAND_2GHZ)
-		band = FREQ_BAND_2DOT4GHZ;
+		pl->band = FREQ_BAND_2DOT4GHZ;
 	else if (channel->band == NL80211_BAND_5GHZ)
-		band = FREQ_BAND_5GHZ;
+		pl->band = FREQ_BAND_5GHZ;
+	else
+		pl->band = 0;
 
 	switch (conf->chandef.width) {
 	case NL80211_CHAN_WIDTH_20_NOHT:
 	case NL80211_CHAN_WIDTH_20:
-		width = CH_20_MHZ_WIDTH;
-		sub_ch = NO_EXT_CHANNEL;
+		pl->width = CH_20_MHZ_WIDTH;
+		pl->sub_ch = NO_EXT_CHANNEL;
 		break;
 	case NL80211_CHAN_WIDTH_40:
-		width = CH_40_MHZ_WIDTH;
+		pl->width = CH_40_MHZ_WIDTH;
 		if (conf->chandef.center_freq1 > channel->center_freq)
-			sub_ch = EXT_CH_ABOVE_CTRL_CH;
+			pl->sub_ch = EXT_CH_ABOVE_CTRL_CH;
 		else
-			sub_ch = EXT_CH_BELOW_CTRL_CH;
+			pl->sub_ch = EXT_CH_BELOW_CTRL_CH;
 		break;
 	case NL80211_CHAN_WIDTH_80:
-		width = CH_80_MHZ_WIDTH;
+		pl->width = CH_80_MHZ_WIDTH;
 		if (conf->chandef.center_freq1 > channel->center_freq)
-			sub_ch = EXT_CH_ABOVE_CTRL_CH;
+			pl->sub_ch = EXT_CH_ABOVE_CTRL_CH;
 		else
-			sub_ch = EXT_CH_BELOW_CTRL_CH;
+			pl->sub_ch = EXT_CH_BELOW_CTRL_CH;
 		break;
 	default:
 		return -EINVAL;
 	}
 
+	return 0;
+}
+
+static int mwl_fwcmd_send_pwr(struct mwl_priv *priv,
+			      struct mwl_pwr_payload *pl)
+{
+	return mwl_fwcmd_set_tx_powers(priv, pl->pow, pl->action, pl->ch,
+				       pl->band, pl->width, pl->sub_ch);
+}
+
+static int mwl_fwcmd_calc_max_tx_power(struct mwl_priv *priv,
+				       struct ieee80211_conf *conf,
+				       u8 fraction,
+				       struct mwl_pwr_payload *pl)
+{
+	int reduce_val = mwl_fwcmd_pwr_reduce(fraction);
+	int i, tmp;
+	int rc;
+
+	rc = mwl_fwcmd_pwr_chan(conf, pl);
+	if (rc)
+		return rc;
+
 	if (priv->chip_type == MWL8997) {
 		mwl_fwcmd_get_tx_powers(priv, priv->max_tx_pow,
 					HOSTCMD_ACT_GET_MAX_TX_PWR,
-					channel->hw_value, band, width, sub_ch);
+					pl->ch, pl->band, pl->width,
+					pl->sub_ch);
 
 		for (i = 0; i < priv->pwr_level; i++) {
 			tmp = priv->max_tx_pow[i];
-			maxtxpow[i] = ((tmp - reduce_val) > 0) ?
+			pl->pow[i] = ((tmp - reduce_val) > 0) ?
 				(tmp - reduce_val) : 0;
 		}
+		pl->action = HOSTCMD_ACT_SET_MAX_TX_PWR;
 
-		rc = mwl_fwcmd_set_tx_powers(priv, maxtxpow,
-					     HOSTCMD_ACT_SET_MAX_TX_PWR,
-					     channel->hw_value, band,
-					     width, sub_ch);
-		return rc;
+		return 0;
 	}
 
 	if ((priv->powinited & MWL_POWER_INIT_2) == 0) {
 		mwl_fwcmd_get_tx_powers(priv, priv->max_tx_pow,
 					HOSTCMD_ACT_GEN_GET_LIST,
-					channel->hw_value, band, width, sub_ch);
+					pl->ch, pl->band, pl->width,
+					pl->sub_ch);
 		priv->powinited |= MWL_POWER_INIT_2;
 	}
 
 	if ((priv->powinited & MWL_POWER_INIT_1) == 0) {
 		mwl_fwcmd_get_tx_powers(priv, priv->target_powers,
 					HOSTCMD_ACT_GEN_GET_LIST,
-					channel->hw_value, band, width, sub_ch);
+					pl->ch, pl->band, pl->width,
+					pl->sub_ch);
 		priv->powinited |= MWL_POWER_INIT_1;
 	}
 
@@ -1231,95 +1281,41 @@ int mwl_fwcmd_max_tx_power(struct ieee80211_hw *hw,
 			tmp = priv->max_tx_pow[i];
 		else
 			tmp = priv->target_powers[i];
-		maxtxpow[i] = ((tmp - reduce_val) > 0) ? (tmp - reduce_val) : 0;
+		pl->pow[i] = ((tmp - reduce_val) > 0) ? (tmp - reduce_val) : 0;
 	}
+	pl->action = HOSTCMD_ACT_GEN_SET;
 
-	rc = mwl_fwcmd_set_tx_powers(priv, maxtxpow, HOSTCMD_ACT_GEN_SET,
-				     channel->hw_value, band, width, sub_ch);
-
-	return rc;
+	return 0;
 }
 
-int mwl_fwcmd_tx_power(struct ieee80211_hw *hw,
-		       struct ieee80211_conf *conf, u8 fraction)
+static int mwl_fwcmd_calc_tx_power(struct mwl_priv *priv,
+				   struct ieee80211_conf *conf,
+				   u8 fraction,
+				   struct mwl_pwr_payload *pl)
 {
-	struct ieee80211_channel *channel = conf->chandef.chan;
-	struct mwl_priv *priv = hw->priv;
-	int reduce_val = 0;
-	u16 band = 0, width = 0, sub_ch = 0;
-	u16 txpow[SYSADPT_TX_GRP_PWR_LEVEL_TOTAL];
+	int reduce_val = mwl_fwcmd_pwr_reduce(fraction);
 	int index, found = 0;
 	int i, tmp;
-	int rc = 0;
+	int rc;
 
-	if ((priv->chip_type != MWL8997) && (priv->forbidden_setting))
+	rc = mwl_fwcmd_pwr_chan(conf, pl);
+	if (rc)
 		return rc;
 
-	switch (fraction) {
-	case 0:
-		reduce_val = 0;    /* Max */
-		break;
-	case 1:
-		reduce_val = 2;    /* 75% -1.25db */
-		break;
-	case 2:
-		reduce_val = 3;    /* 50% -3db */
-		break;
-	case 3:
-		reduce_val = 6;    /* 25% -6db */
-		break;
-	default:
-		/* larger than case 3,  pCmd->MaxPowerLevel is min */
-		reduce_val = 0xff;
-		break;
-	}
-
-	if (channel->band == NL80211_BAND_2GHZ)
-		band = FREQ_BAND_2DOT4GHZ;
-	else if (channel->band == NL80211_BAND_5GHZ)
-		band = FREQ_BAND_5GHZ;
-
-	switch (conf->chandef.width) {
-	case NL80211_CHAN_WIDTH_20_NOHT:
-	case NL80211_CHAN_WIDTH_20:
-		width = CH_20_MHZ_WIDTH;
-		sub_ch = NO_EXT_CHANNEL;
-		break;
-	case NL80211_CHAN_WIDTH_40:
-		width = CH_40_MHZ_WIDTH;
-		if (conf->chandef.center_freq1 > channel->center_freq)
-			sub_ch = EXT_CH_ABOVE_CTRL_CH;
-		else
-			sub_ch = EXT_CH_BELOW_CTRL_CH;
-		break;
-	case NL80211_CHAN_WIDTH_80:
-		width = CH_80_MHZ_WIDTH;
-		if (conf->chandef.center_freq1 > channel->center_freq)
-			sub_ch = EXT_CH_ABOVE_CTRL_CH;
-		else
-			sub_ch = EXT_CH_BELOW_CTRL_CH;
-		break;
-	default:
-		return -EINVAL;
-	}
-
 	if (priv->chip_type == MWL8997) {
 		mwl_fwcmd_get_tx_powers(priv, priv->target_powers,
 					HOSTCMD_ACT_GET_TARGET_TX_PWR,
-					channel->hw_value, band, width, sub_ch);
+					pl->ch, pl->band, pl->width,
+					pl->sub_ch);
 
 		for (i = 0; i < priv->pwr_level; i++) {
 			tmp = priv->target_powers[i];
-			txpow[i] = ((tmp - reduce_val) > 0) ?
+			pl->pow[i] = ((tmp - reduce_val) > 0) ?
 				(tmp - reduce_val) : 0;
 		}
+		pl->action = HOSTCMD_ACT_SET_TARGET_TX_PWR;
 
-		rc = mwl_fwcmd_set_tx_powers(priv, txpow,
-					     HOSTCMD_ACT_SET_TARGET_TX_PWR,
-					     channel->hw_value, band,
-					     width, sub_ch);
-
-		return rc;
+		return 0;
 	}
 
 	/* search tx power table if exist */
@@ -1332,7 +1328,7 @@ int mwl_fwcmd_tx_power(struct ieee80211_hw *hw,
 		if (tx_pwr->channel == 0)
 			break;
 
-		if (tx_pwr->channel == channel->hw_value) {
+		if (tx_pwr->channel == pl->ch) {
 			priv->cdd = tx_pwr->cdd;
 			priv->txantenna2 = tx_pwr->txantenna2;
 
@@ -1358,7 +1354,8 @@ int mwl_fwcmd_tx_power(struct ieee80211_hw *hw,
 	if ((priv->powinited & MWL_POWER_INIT_2) == 0) {
 		mwl_fwcmd_get_tx_powers(priv, priv->max_tx_pow,
 					HOSTCMD_ACT_GEN_GET_LIST,
-					channel->hw_value, band, width, sub_ch);
+					pl->ch, pl->band, pl->width,
+					pl->sub_ch);
 
 		priv->powinited |= MWL_POWER_INIT_2;
 	}
@@ -1366,7 +1363,8 @@ int mwl_fwcmd_tx_power(struct ieee80211_hw *hw,
 	if ((priv->powinited & MWL_POWER_INIT_1) == 0) {
 		mwl_fwcmd_get_tx_powers(priv, priv->target_powers,
 					HOSTCMD_ACT_GEN_GET_LIST,
-					channel->hw_value, band, width, sub_ch);
+					pl->ch, pl->band, pl->width,
+					pl->sub_ch);
 
 		priv->powinited |= MWL_POWER_INIT_1;
 	}
@@ -1386,13 +1384,39 @@ int mwl_fwcmd_tx_power(struct ieee80211_hw *hw,
 				tmp = priv->target_powers[i];
 		}
 
-		txpow[i] = ((tmp - reduce_val) > 0) ? (tmp - reduce_val) : 0;
+		pl->pow[i] = ((tmp - reduce_val) > 0) ? (tmp - reduce_val) : 0;
 	}
+	pl->action = HOSTCMD_ACT_GEN_SET_LIST;
 
-	rc = mwl_fwcmd_set_tx_powers(priv, txpow, HOSTCMD_ACT_GEN_SET_LIST,
-				     channel->hw_value, band, width, sub_ch);
+	return 0;
+}
 
-	return rc;
+/* Max power first, then target power, as the target payload is built
+ * from the max powers firmware reported.
+ */
+int mwl_fwcmd_chan_tx_power(struct ieee80211_hw *hw,
+			    struct ieee80211_conf *conf, u8 fraction)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct mwl_pwr_payload pl;
+	int rc;
+
+	if ((priv->chip_type != MWL8997) && (priv->forbidden_setting))
+		return 0;
+
+	rc = mwl_fwcmd_calc_max_tx_power(priv, conf, fraction, &pl);
+	if (rc)
+		return rc;
+
+	rc = mwl_fwcmd_send_pwr(priv, &pl);
+	if (rc)
+		return rc;
+
+	rc = mwl_fwcmd_calc_tx_power(priv, conf, fraction, &pl);
+	if (rc)
+		return rc;
+
+	return mwl_fwcmd_send_pwr(priv, &pl);
 }
 
 int mwl_fwcmd_rf_antenna(struct ieee80211_hw *hw, int dir, int antenna)
@@ -1834,6 +1858,14 @@ int mwl_fwcmd_use_fixed_rate(struct ieee80211_hw *hw, int mcast, int mgmt)
 
 	mutex_lock(&priv->fwcmd_mutex);
 
+	if ((priv->fwcmd_shadow.valid & MWL_SHADOW_FIXED_RATE) &&
+	    priv->fwcmd_shadow.mcast_rate == mcast &&
+	    priv->fwcmd_shadow.mgmt_rate == mgmt) {
+		priv->fwcmd_shadow.hits++;
+		mutex_unlock(&priv->fwcmd_mutex);
+		return 0;
+	}
+
 	memset(pcmd, 0x00, sizeof(*pcmd));
 	pcmd->cmd_hdr.cmd = cpu_to_le16(HOSTCMD_CMD_SET_FIXED_RATE);
 	pcmd->cmd_hdr.len = cpu_to_le16(sizeof(*pcmd));
@@ -1843,10 +1875,15 @@ int mwl_fwcmd_use_fixed_rate(struct ieee80211_hw *hw, int mcast, int mgmt)
 	pcmd->management_rate = mgmt;
 
 	if (mwl_hif_exec_cmd(hw, HOSTCMD_CMD_SET_FIXED_RATE)) {
+		priv->fwcmd_shadow.valid &= ~MWL_SHADOW_FIXED_RATE;
 		mutex_unlock(&priv->fwcmd_mutex);
 		return -EIO;
 	}
 
+	priv->fwcmd_shadow.mcast_rate = mcast;
+	priv->fwcmd_shadow.mgmt_rate = mgmt;
+	priv->fwcmd_shadow.valid |= MWL_SHADOW_FIXED_RATE;
+
 	mutex_unlock(&priv->fwcmd_mutex);
 
 	return 0;
@@ -1861,6 +1898,13 @@ int mwl_fwcmd_set_linkadapt_cs_mode(struct ieee80211_hw *hw, u16 cs_mode)
 
 	mutex_lock(&priv->fwcmd_mutex);
 
+	if ((priv->fwcmd_shadow.valid & MWL_SHADOW_CS_MODE) &&
+	    priv->fwcmd_shadow.cs_mode == cs_mode) {
+		priv->fwcmd_shadow.hits++;
+		mutex_unlock(&priv->fwcmd_mutex);
+		return 0;
+	}
+
 	memset(pcmd, 0x00, sizeof(*pcmd));
 	pcmd->cmd_hdr.cmd = cpu_to_le16(HOSTCMD_CMD_SET_LINKADAPT_CS_MODE);
 	pcmd->cmd_hdr.len = cpu_to_le16(sizeof(*pcmd));
@@ -1868,10 +1912,14 @@ int mwl_fwcmd_set_linkadapt_cs_mode(struct ieee80211_hw *hw, u16 cs_mode)
 	pcmd->cs_mode = cpu_to_le16(cs_mode);
 
 	if (mwl_hif_exec_cmd(hw, HOSTCMD_CMD_SET_LINKADAPT_CS_MODE)) {
+		priv->fwcmd_shadow.valid &= ~MWL_SHADOW_CS_MODE;
 		mutex_unlock(&priv->fwcmd_mutex);
 		return -EIO;
 	}
 
+	priv->fwcmd_shadow.cs_mode = cs_mode;
+	priv->fwcmd_shadow.valid |= MWL_SHADOW_CS_MODE;
+
 	mutex_unlock(&priv->fwcmd_mutex);
 
 	return 0;
@@ -2122,23 +2170,16 @@ err:
 	return -EIO;
 }
 
-int mwl_fwcmd_set_new_stn_add(struct ieee80211_hw *hw,
-			      struct ieee80211_vif *vif,
-			      struct ieee80211_sta *sta)
+static void mwl_fwcmd_fill_new_stn(struct ieee80211_hw *hw,
+				   struct ieee80211_vif *vif,
+				   struct ieee80211_sta *sta,
+				   struct hostcmd_cmd_set_new_stn *pcmd)
 {
 	struct mwl_priv *priv = hw->priv;
-	struct mwl_vif *mwl_vif;
-	struct mwl_sta *sta_info;
-	struct hostcmd_cmd_set_new_stn *pcmd;
+	struct mwl_vif *mwl_vif = mwl_dev_get_vif(vif);
+	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
 	u32 rates;
 
-	mwl_vif = mwl_dev_get_vif(vif);
-	sta_info = mwl_dev_get_sta(sta);
-
-	pcmd = (struct hostcmd_cmd_set_new_stn *)&priv->pcmd_buf[0];
-
-	mutex_lock(&priv->fwcmd_mutex);
-
 	memset(pcmd, 0x00, sizeof(*pcmd));
 	pcmd->cmd_hdr.cmd = cpu_to_le16(HOSTCMD_CMD_SET_NEW_STN);
 	pcmd->cmd_hdr.len = cpu_to_le16(sizeof(*pcmd));
@@ -2190,6 +2231,25 @@ int mwl_fwcmd_set_new_stn_add(struct ieee80211_hw *hw,
 
 	pcmd->is_qos_sta = sta->wme;
 	pcmd->qos_info = ((sta->uapsd_queues << 4) | (sta->max_sp << 1));
+}
+
+int mwl_fwcmd_set_new_stn_add(struct ieee80211_hw *hw,
+			      struct ieee80211_vif *vif,
+			      struct ieee80211_sta *sta)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct mwl_vif *mwl_vif;
+	struct mwl_sta *sta_info;
+	struct hostcmd_cmd_set_new_stn *pcmd;
+
+	mwl_vif = mwl_dev_get_vif(vif);
+	sta_info = mwl_dev_get_sta(sta);
+
+	pcmd = (struct hostcmd_cmd_set_new_stn *)&priv->pcmd_buf[0];
+
+	mutex_lock(&priv->fwcmd_mutex);
+
+	mwl_fwcmd_fill_new_stn(hw, vif, sta, pcmd);
 
 	if (mwl_hif_exec_cmd(hw, HOSTCMD_CMD_SET_NEW_STN)) {
 		mutex_unlock(&priv->fwcmd_mutex);
@@ -2212,24 +2272,15 @@ int mwl_fwcmd_set_new_stn_add(struct ieee80211_hw *hw,
 	return 0;
 }
 
-int mwl_fwcmd_set_new_stn_add_sc4(struct ieee80211_hw *hw,
-				  struct ieee80211_vif *vif,
-				  struct ieee80211_sta *sta,
-				  u32 wds)
+static void mwl_fwcmd_fill_new_stn_sc4(struct ieee80211_hw *hw,
+				       struct ieee80211_vif *vif,
+				       struct ieee80211_sta *sta, u32 wds,
+				       struct hostcmd_cmd_set_new_stn_sc4 *pcmd)
 {
-	struct mwl_priv *priv = hw->priv;
-	struct mwl_vif *mwl_vif;
-	struct mwl_sta *sta_info;
-	struct hostcmd_cmd_set_new_stn_sc4 *pcmd;
+	struct mwl_vif *mwl_vif = mwl_dev_get_vif(vif);
+	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
 	u32 rates;
 
-	mwl_vif = mwl_dev_get_vif(vif);
-	sta_info = mwl_dev_get_sta(sta);
-
-	pcmd = (struct hostcmd_cmd_set_new_stn_sc4 *)&priv->pcmd_buf[0];
-
-	mutex_lock(&priv->fwcmd_mutex);
-
 	memset(pcmd, 0x00, sizeof(*pcmd));
 	pcmd->cmd_hdr.cmd = cpu_to_le16(HOSTCMD_CMD_SET_NEW_STN);
 	pcmd->cmd_hdr.len = cpu_to_le16(sizeof(*pcmd));
@@ -2278,6 +2329,26 @@ int mwl_fwcmd_set_new_stn_add_sc4(struct ieee80211_hw *hw,
 	pcmd->is_qos_sta = sta->wme;
 	pcmd->qos_info = ((sta->uapsd_queues << 4) | (sta->max_sp << 1));
 	pcmd->wds = cpu_to_le32(wds);
+}
+
+int mwl_fwcmd_set_new_stn_add_sc4(struct ieee80211_hw *hw,
+				  struct ieee80211_vif *vif,
+				  struct ieee80211_sta *sta,
+				  u32 wds)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct mwl_vif *mwl_vif;
+	struct mwl_sta *sta_info;
+	struct hostcmd_cmd_set_new_stn_sc4 *pcmd;
+
+	mwl_vif = mwl_dev_get_vif(vif);
+	sta_info = mwl_dev_get_sta(sta);
+
+	pcmd = (struct hostcmd_cmd_set_new_stn_sc4 *)&priv->pcmd_buf[0];
+
+	mutex_lock(&priv->fwcmd_mutex);
+
+	mwl_fwcmd_fill_new_stn_sc4(hw, vif, sta, wds, pcmd);
 
 	if (mwl_hif_exec_cmd(hw, HOSTCMD_CMD_SET_NEW_STN)) {
 		mutex_unlock(&priv->fwcmd_mutex);
@@ -2418,16 +2489,27 @@ int mwl_fwcmd_set_apmode(struct ieee80211_hw *hw, u8 apmode)
 
 	mutex_lock(&priv->fwcmd_mutex);
 
+	if ((priv->fwcmd_shadow.valid & MWL_SHADOW_APMODE) &&
+	    priv->fwcmd_shadow.apmode == apmode) {
+		priv->fwcmd_shadow.hits++;
+		mutex_unlock(&priv->fwcmd_mutex);
+		return 0;
+	}
+
 	memset(pcmd, 0x00, sizeof(*pcmd));
 	pcmd->cmd_hdr.cmd = cpu_to_le16(HOSTCMD_CMD_SET_APMODE);
 	pcmd->cmd_hdr.len = cpu_to_le16(sizeof(*pcmd));
 	pcmd->apmode = apmode;
 
 	if (mwl_hif_exec_cmd(hw, HOSTCMD_CMD_SET_APMODE)) {
+		priv->fwcmd_shadow.valid &= ~MWL_SHADOW_APMODE;
 		mutex_unlock(&priv->fwcmd_mutex);
 		return -EIO;
 	}
 
+	priv->fwcmd_shadow.apmode = apmode;
+	priv->fwcmd_shadow.valid |= MWL_SHADOW_APMODE;
+
 	mutex_unlock(&priv->fwcmd_mutex);
 
 	return 0;
@@ -2745,22 +2827,16 @@ int mwl_fwcmd_check_ba(struct ieee80211_hw *hw,
 	return 0;
 }
 
-int mwl_fwcmd_create_ba(struct ieee80211_hw *hw,
-			struct mwl_ampdu_stream *stream,
-			struct ieee80211_vif *vif,
-			u32 direction, u8 buf_size, u16 seqno, bool amsdu)
+static void mwl_fwcmd_fill_create_ba(struct mwl_priv *priv,
+				     struct hostcmd_cmd_bastream *pcmd,
+				     struct mwl_ampdu_stream *stream,
+				     struct ieee80211_vif *vif,
+				     u32 direction, u8 buf_size, u16 seqno,
+				     bool amsdu)
 {
-	struct mwl_priv *priv = hw->priv;
-	struct mwl_vif *mwl_vif;
-	struct hostcmd_cmd_bastream *pcmd;
+	struct mwl_vif *mwl_vif = mwl_dev_get_vif(vif);
 	u32 ba_flags, ba_type, ba_direction;
 
-	mwl_vif = mwl_dev_get_vif(vif);
-
-	pcmd = (struct hostcmd_cmd_bastream *)&priv->pcmd_buf[0];
-
-	mutex_lock(&priv->fwcmd_mutex);
-
 	memset(pcmd, 0x00, sizeof(*pcmd));
 	pcmd->cmd_hdr.cmd = cpu_to_le16(HOSTCMD_CMD_BASTREAM);
 	pcmd->cmd_hdr.len = cpu_to_le16(sizeof(*pcmd));
@@ -2807,6 +2883,22 @@ int mwl_fwcmd_create_ba(struct ieee80211_hw *hw,
 			IEEE80211_VHT_CAP_MAX_A_MPDU_LENGTH_EXPONENT_MASK) >>
 			IEEE80211_VHT_CAP_MAX_A_MPDU_LENGTH_EXPONENT_SHIFT);
 	}
+}
+
+int mwl_fwcmd_create_ba(struct ieee80211_hw *hw,
+			struct mwl_ampdu_stream *stream,
+			struct ieee80211_vif *vif,
+			u32 direction, u8 buf_size, u16 seqno, bool amsdu)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct hostcmd_cmd_bastream *pcmd;
+
+	pcmd = (struct hostcmd_cmd_bastream *)&priv->pcmd_buf[0];
+
+	mutex_lock(&priv->fwcmd_mutex);
+
+	mwl_fwcmd_fill_create_ba(priv, pcmd, stream, vif, direction,
+				 buf_size, seqno, amsdu);
 
 	if (mwl_hif_exec_cmd(hw, HOSTCMD_CMD_BASTREAM)) {
 		mutex_unlock(&priv->fwcmd_mutex);
@@ -2825,18 +2917,13 @@ int mwl_fwcmd_create_ba(struct ieee80211_hw *hw,
 	return 0;
 }
 
-int mwl_fwcmd_destroy_ba(struct ieee80211_hw *hw,
-			 struct mwl_ampdu_stream *stream,
-			 u32 direction)
+static void mwl_fwcmd_fill_destroy_ba(struct mwl_priv *priv,
+				      struct hostcmd_cmd_bastream *pcmd,
+				      struct mwl_ampdu_stream *stream,
+				      u32 direction)
 {
-	struct mwl_priv *priv = hw->priv;
-	struct hostcmd_cmd_bastream *pcmd;
 	u32 ba_flags, ba_type, ba_direction;
 
-	pcmd = (struct hostcmd_cmd_bastream *)&priv->pcmd_buf[0];
-
-	mutex_lock(&priv->fwcmd_mutex);
-
 	memset(pcmd, 0x00, sizeof(*pcmd));
 	pcmd->cmd_hdr.cmd = cpu_to_le16(HOSTCMD_CMD_BASTREAM);
 	pcmd->cmd_hdr.len = cpu_to_le16(sizeof(*pcmd));
@@ -2858,6 +2945,20 @@ int mwl_fwcmd_destroy_ba(struct ieee80211_hw *hw,
 	pcmd->ba_info.destroy_params.tid = stream->tid;
 	ether_addr_copy(&pcmd->ba_info.destroy_params.peer_mac_addr[0],
 			stream->sta->addr);
+}
+
+int mwl_fwcmd_destroy_ba(struct ieee80211_hw *hw,
+			 struct mwl_ampdu_stream *stream,
+			 u32 direction)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct hostcmd_cmd_bastream *pcmd;
+
+	pcmd = (struct hostcmd_cmd_bastream *)&priv->pcmd_buf[0];
+
+	mutex_lock(&priv->fwcmd_mutex);
+
+	mwl_fwcmd_fill_destroy_ba(priv, pcmd, stream, direction);
 
 	if (mwl_hif_exec_cmd(hw, HOSTCMD_CMD_BASTREAM)) {
 		mutex_unlock(&priv->fwcmd_mutex);
@@ -2869,59 +2970,64 @@ int mwl_fwcmd_destroy_ba(struct ieee80211_hw *hw,
 	return 0;
 }
 
+static struct mwl_ampdu_stream *
+mwl_fwcmd_init_stream(struct mwl_priv *priv, struct ieee80211_sta *sta,
+		      u8 tid, int idx)
+{
+	struct mwl_ampdu_stream *stream = &priv->ampdu[idx];
+
+	stream->sta = sta;
+	stream->state = AMPDU_STREAM_NEW;
+	stream->tid = tid;
+	stream->idx = idx;
+	WRITE_ONCE(mwl_dev_get_sta(sta)->ampdu[tid], stream);
+
+	return stream;
+}
+
 /* caller must hold priv->stream_lock when calling the stream functions */
 struct mwl_ampdu_stream *mwl_fwcmd_add_stream(struct ieee80211_hw *hw,
 					      struct ieee80211_sta *sta,
 					      u8 tid)
 {
 	struct mwl_priv *priv = hw->priv;
-	struct mwl_ampdu_stream *stream;
 	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
 	int idx;
-	int ac = utils_tid_to_ac(tid);
+	int ac;
+
+	if (tid >= MWL_MAX_TID)
+		return NULL;
 
 	if (priv->chip_type == MWL8964) {
 		idx = ((sta_info->stnid - 1) * SYSADPT_MAX_TID) + tid;
 
-		if (idx < priv->ampdu_num) {
-			stream = &priv->ampdu[idx];
-			stream->sta = sta;
-			stream->state = AMPDU_STREAM_NEW;
-			stream->tid = tid;
-			stream->idx = idx;
-			return stream;
+		if (idx < priv->ampdu_num)
+			return mwl_fwcmd_init_stream(priv, sta, tid, idx);
+
+		return NULL;
+	}
+
+	if (sta_info->ampdu[tid])
+		return NULL;
+
+	ac = utils_tid_to_ac(tid);
+	switch (ac) {
+	case IEEE80211_AC_VI:
+	case IEEE80211_AC_VO:
+		idx = priv->ampdu_num;
+		while (idx--) {
+			if (priv->ampdu[idx].state == AMPDU_NO_STREAM)
+				return mwl_fwcmd_init_stream(priv, sta,
+							     tid, idx);
 		}
-	} else {
-		switch(ac) {
-			case IEEE80211_AC_VI:
-			case IEEE80211_AC_VO:
-				idx = priv->ampdu_num;
-				while (idx--) {
-					stream = &priv->ampdu[idx];
-
-					if (stream->state == AMPDU_NO_STREAM) {
-						stream->sta = sta;
-						stream->state = AMPDU_STREAM_NEW;
-						stream->tid = tid;
-						stream->idx = idx;
-						return stream;
-					}
-				};
-				break;
-			default:
-				for (idx = 0; idx < priv->ampdu_num; idx++) {
-					stream = &priv->ampdu[idx];
-
-					if (stream->state == AMPDU_NO_STREAM) {
-						stream->sta = sta;
-						stream->state = AMPDU_STREAM_NEW;
-						stream->tid = tid;
-						stream->idx = idx;
-						return stream;
-					}
-				};
-			break;
+		break;
+	default:
+		for (idx = 0; idx < priv->ampdu_num; idx++) {
+			if (priv->ampdu[idx].state == AMPDU_NO_STREAM)
+				return mwl_fwcmd_init_stream(priv, sta,
+							     tid, idx);
 		}
+		break;
 	}
 
 	return NULL;
@@ -2950,10 +3056,10 @@ void mwl_fwcmd_del_sta_streams(struct ieee80211_hw *hw,
 			}
 		}
 	} else {
-		for (idx = 0; idx < priv->ampdu_num; idx++) {
-			stream = &priv->ampdu[idx];
+		for (i = 0; i < MWL_MAX_TID; i++) {
+			stream = sta_info->ampdu[i];
 
-			if (stream->sta == sta) {
+			if (stream && stream->sta == sta) {
 				spin_unlock_bh(&priv->stream_lock);
 				mwl_fwcmd_destroy_ba(hw, stream,
 						     BA_FLAG_DIRECTION_UP);
@@ -2975,9 +3081,37 @@ int mwl_fwcmd_start_stream(struct ieee80211_hw *hw,
 	return ieee80211_start_tx_ba_session(stream->sta, stream->tid, 0);
 }
 
+/* The queue index of an active stream is published to the xmit paths,
+ * which read it without stream_lock.
+ */
+void mwl_fwcmd_set_stream_state(struct mwl_ampdu_stream *stream, u8 state)
+{
+	struct mwl_sta *sta_info;
+
+	stream->state = state;
+
+	if (!stream->sta || stream->tid >= MWL_MAX_TID)
+		return;
+
+	sta_info = mwl_dev_get_sta(stream->sta);
+	if (sta_info->ampdu[stream->tid] == stream)
+		WRITE_ONCE(sta_info->ampdu_txq[stream->tid],
+			   (state == AMPDU_STREAM_ACTIVE) ? stream->idx + 1 : 0);
+}
+
 void mwl_fwcmd_remove_stream(struct ieee80211_hw *hw,
 			     struct mwl_ampdu_stream *stream)
 {
+	struct mwl_sta *sta_info;
+
+	if (stream->sta && stream->tid < MWL_MAX_TID) {
+		sta_info = mwl_dev_get_sta(stream->sta);
+		if (sta_info->ampdu[stream->tid] == stream) {
+			WRITE_ONCE(sta_info->ampdu_txq[stream->tid], 0);
+			WRITE_ONCE(sta_info->ampdu[stream->tid], NULL);
+		}
+	}
+
 	memset(stream, 0, sizeof(*stream));
 }
 
@@ -2986,26 +3120,20 @@ struct mwl_ampdu_stream *mwl_fwcmd_lookup_stream(struct ieee80211_hw *hw,
 						 u8 tid)
 {
 	struct mwl_priv *priv = hw->priv;
-	struct mwl_ampdu_stream *stream;
 	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
 	int idx;
 
+	if (tid >= MWL_MAX_TID)
+		return NULL;
+
 	if (priv->chip_type == MWL8964) {
 		idx = ((sta_info->stnid - 1) * SYSADPT_MAX_TID) + tid;
 		if (idx < priv->ampdu_num)
 			return &priv->ampdu[idx];
-	} else {
-		for (idx = 0; idx < priv->ampdu_num; idx++) {
-			stream = &priv->ampdu[idx];
-			if (stream->state == AMPDU_NO_STREAM)
-				continue;
-
-			if ((stream->sta == sta) && (stream->tid == tid))
-				return stream;
-		}
+		return NULL;
 	}
 
-	return NULL;
+	return sta_info->ampdu[tid];
 }
 
 bool mwl_fwcmd_ampdu_allowed(struct ieee80211_sta *sta, u8 tid)
@@ -3194,16 +3322,27 @@ int mwl_fwcmd_set_cdd(struct ieee80211_hw *hw)
 
 	mutex_lock(&priv->fwcmd_mutex);
 
+	if ((priv->fwcmd_shadow.valid & MWL_SHADOW_CDD) &&
+	    priv->fwcmd_shadow.cdd == priv->cdd) {
+		priv->fwcmd_shadow.hits++;
+		mutex_unlock(&priv->fwcmd_mutex);
+		return 0;
+	}
+
 	memset(pcmd, 0x00, sizeof(*pcmd));
 	pcmd->cmd_hdr.cmd = cpu_to_le16(HOSTCMD_CMD_SET_CDD);
 	pcmd->cmd_hdr.len = cpu_to_le16(sizeof(*pcmd));
 	pcmd->enable = cpu_to_le32(priv->cdd);
 
 	if (mwl_hif_exec_cmd(hw, HOSTCMD_CMD_SET_CDD)) {
+		priv->fwcmd_shadow.valid &= ~MWL_SHADOW_CDD;
 		mutex_unlock(&priv->fwcmd_mutex);
 		return -EIO;
 	}
 
+	priv->fwcmd_shadow.cdd = priv->cdd;
+	priv->fwcmd_shadow.valid |= MWL_SHADOW_CDD;
+
 	mutex_unlock(&priv->fwcmd_mutex);
 
 	return 0;
@@ -65,6 +65,8 @@ enum encr_type {
 
 char *mwl_fwcmd_get_cmd_string(unsigned short cmd);
 
+void mwl_fwcmd_shadow_invalidate(struct ieee80211_hw *hw);
+
 const struct hostcmd_get_hw_spec
 *mwl_fwcmd_get_hw_specs(struct ieee80211_hw *hw);
 
@@ -88,11 +90,8 @@ int mwl_fwcmd_set_radio_preamble(struct ieee80211_hw *hw,
 int mwl_fwcmd_get_addr_value(struct ieee80211_hw *hw, u32 addr, u32 len,
 			     u32 *val, u16 set);
 
-int mwl_fwcmd_max_tx_power(struct ieee80211_hw *hw,
-			   struct ieee80211_conf *conf, u8 fraction);
-
-int mwl_fwcmd_tx_power(struct ieee80211_hw *hw,
-		       struct ieee80211_conf *conf, u8 fraction);
+int mwl_fwcmd_chan_tx_power(struct ieee80211_hw *hw,
+			    struct ieee80211_conf *conf, u8 fraction);
 
 int mwl_fwcmd_rf_antenna(struct ieee80211_hw *hw, int dir, int antenna);
 
@@ -206,6 +205,8 @@ void mwl_fwcmd_del_sta_streams(struct ieee80211_hw *hw,
 int mwl_fwcmd_start_stream(struct ieee80211_hw *hw,
 			   struct mwl_ampdu_stream *stream);
 
+void mwl_fwcmd_set_stream_state(struct mwl_ampdu_stream *stream, u8 state);
+
 void mwl_fwcmd_remove_stream(struct ieee80211_hw *hw,
 			     struct mwl_ampdu_stream *stream);
 
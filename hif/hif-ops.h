@@ -194,6 +194,15 @@ static inline void mwl_hif_tx_xmit(struct ieee80211_hw *hw,
 		priv->hif.ops->tx_xmit(hw, control, skb);
 }
 
+static inline void mwl_hif_tx_wake_queue(struct ieee80211_hw *hw,
+					 struct ieee80211_txq *txq)
+{
+	struct mwl_priv *priv = hw->priv;
+
+	if (priv->hif.ops->tx_wake_queue)
+		priv->hif.ops->tx_wake_queue(hw, txq);
+}
+
 static inline void mwl_hif_tx_del_pkts_via_vif(struct ieee80211_hw *hw,
 					       struct ieee80211_vif *vif)
 {
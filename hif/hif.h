@@ -59,6 +59,8 @@ struct mwl_hif_ops {
 	void (*tx_xmit)(struct ieee80211_hw *hw,
 			struct ieee80211_tx_control *control,
 			struct sk_buff *skb);
+	void (*tx_wake_queue)(struct ieee80211_hw *hw,
+			      struct ieee80211_txq *txq);
 	void (*tx_del_pkts_via_vif)(struct ieee80211_hw *hw,
 				    struct ieee80211_vif *vif);
 	void (*tx_del_pkts_via_sta)(struct ieee80211_hw *hw,
@@ -48,6 +48,10 @@ struct pcie_tx_ctrl {
 	u8 xmit_control;
 };
 
+static void pcie_tx_enqueue(struct ieee80211_hw *hw,
+			    struct ieee80211_sta *sta,
+			    struct sk_buff *skb);
+
 static int pcie_tx_ring_alloc(struct mwl_priv *priv)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
@@ -111,6 +115,9 @@ static int pcie_tx_ring_init(struct mwl_priv *priv)
 	int num, i;
 	struct pcie_desc_data *desc;
 
+	for (num = 0; num < SYSADPT_TX_WMM_QUEUES; num++)
+		INIT_LIST_HEAD(&pcie_priv->amsdu_pend[num]);
+
 	for (num = 0; num < PCIE_NUM_OF_DESC_DATA; num++) {
 		skb_queue_head_init(&pcie_priv->txq[num]);
 		pcie_priv->fw_desc_cnt[num] = 0;
@@ -372,10 +379,12 @@ struct sk_buff *pcie_tx_do_amsdu(struct mwl_priv *priv,
 				    (pcie_priv->tx_head_room - headroom));
 
 		skb_put_data(amsdu->skb, tx_skb->data, wh_len + iv_len);
+		priv->amsdu_stats.copy_bytes += wh_len + iv_len;
 
 		tx_ctrl->qos_ctrl |= IEEE80211_QOS_CTL_A_MSDU_PRESENT;
 		amsdu_info = IEEE80211_SKB_CB(amsdu->skb);
 		memcpy(amsdu_info, tx_info, sizeof(*tx_info));
+		priv->amsdu_stats.aggr++;
 	} else if (amsdu->pad)
 			skb_put_zero(amsdu->skb, amsdu->pad);
 
@@ -394,7 +403,12 @@ struct sk_buff *pcie_tx_do_amsdu(struct mwl_priv *priv,
 	*(u8 *)(data + ETH_HLEN - 2) = (len >> 8) & 0xff;
 
 	skb_put_data(amsdu->skb, tx_skb->data + wh_len + iv_len, len);
+	priv->amsdu_stats.copy_bytes += len;
+	priv->amsdu_stats.msdus++;
+	priv->amsdu_stats.bytes += len;
 
+	if (list_empty(&amsdu->list))
+		list_add_tail(&amsdu->list, &pcie_priv->amsdu_pend[desc_num]);
 	amsdu->num++;
 	amsdu->pad = ((len + ETH_HLEN) % 4) ? (4 - (len + ETH_HLEN) % 4) : 0;
 	dev_kfree_skb_any(tx_skb);
@@ -489,7 +503,7 @@ next:
 	}
 	spin_unlock_bh(&pcie_priv->tx_desc_lock);
 
-	tasklet_schedule(&pcie_priv->tx_task);
+	pcie_tx_schedule(pcie_priv);
 }
 
 int pcie_8864_tx_init(struct ieee80211_hw *hw)
@@ -540,8 +554,12 @@ void pcie_8864_tx_skbs(unsigned long data)
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 	int num = SYSADPT_TX_WMM_QUEUES;
 	struct sk_buff *tx_skb;
-	struct mwl_amsdu_frag *amsdu_frag;
+	struct mwl_amsdu_frag *amsdu_frag, *tmp;
 	struct mwl_sta *sta_info;
+	int ac;
+
+	for (ac = 0; ac < SYSADPT_TX_WMM_QUEUES; ac++)
+		pcie_tx_pull_txqs(hw, ac, pcie_tx_enqueue);
 
 	spin_lock_bh(&pcie_priv->tx_desc_lock);
 	while (num--) {
@@ -572,10 +590,10 @@ void pcie_8864_tx_skbs(unsigned long data)
 			}
 		}
 
-		spin_lock_bh(&priv->sta_lock);
-		list_for_each_entry(sta_info, &priv->sta_list, list) {
+		list_for_each_entry_safe(amsdu_frag, tmp,
+					 &pcie_priv->amsdu_pend[num], list) {
+			sta_info = amsdu_frag->sta_info;
 			spin_lock_bh(&sta_info->amsdu_lock);
-			amsdu_frag = &sta_info->amsdu_ctrl.frag[num];
 			if (amsdu_frag->num) {
 				if (pcie_tx_available(priv, num))
 					pcie_tx_skb(priv, num, amsdu_frag->skb);
@@ -584,18 +602,9 @@ void pcie_8864_tx_skbs(unsigned long data)
 						       amsdu_frag->skb);
 				amsdu_frag->num = 0;
 			}
+			list_del_init(&amsdu_frag->list);
 			spin_unlock_bh(&sta_info->amsdu_lock);
 		}
-		spin_unlock_bh(&priv->sta_lock);
-
-		if (skb_queue_len(&pcie_priv->txq[num]) <
-		    pcie_priv->txq_wake_threshold) {
-			int queue;
-
-			queue = SYSADPT_TX_WMM_QUEUES - num - 1;
-			if (ieee80211_queue_stopped(hw, queue))
-				ieee80211_wake_queue(hw, queue);
-		}
 	}
 	spin_unlock_bh(&pcie_priv->tx_desc_lock);
 }
@@ -606,7 +615,7 @@ void pcie_8864_tx_done_task(unsigned long data)
 	struct mwl_priv *priv = hw->priv;
 
 	pcie_non_pfu_tx_done(priv);
-	priv->hif.ops->irq_enable(hw);
+	pcie_irq_rearm(hw);
 }
 
 void pcie_8864_tx_done(unsigned long data)
@@ -617,20 +626,20 @@ void pcie_8864_tx_done(unsigned long data)
 	pcie_non_pfu_tx_done(priv);
 }
 
-void pcie_8864_tx_xmit(struct ieee80211_hw *hw,
-		       struct ieee80211_tx_control *control,
-		       struct sk_buff *skb)
+static void pcie_tx_enqueue(struct ieee80211_hw *hw,
+			    struct ieee80211_sta *sta,
+			    struct sk_buff *skb)
 {
 	struct mwl_priv *priv = hw->priv;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 	int index;
-	struct ieee80211_sta *sta;
 	struct ieee80211_tx_info *tx_info;
 	struct mwl_vif *mwl_vif;
 	struct ieee80211_hdr *wh;
 	u8 xmitcontrol;
 	u16 qos;
 	int txpriority;
+	int stream_idx;
 	u8 tid = 0;
 	struct mwl_ampdu_stream *stream = NULL;
 	bool start_ba_session = false;
@@ -641,7 +650,6 @@ void pcie_8864_tx_xmit(struct ieee80211_hw *hw,
 	int rc;
 
 	index = skb_get_queue_mapping(skb);
-	sta = control->sta;
 
 	wh = (struct ieee80211_hdr *)skb->data;
 	tx_info = IEEE80211_SKB_CB(skb);
@@ -736,58 +744,71 @@ void pcie_8864_tx_xmit(struct ieee80211_hw *hw,
 		tid = qos & 0xf;
 		pcie_tx_count_packet(sta, tid);
 
-		spin_lock_bh(&priv->stream_lock);
-		stream = mwl_fwcmd_lookup_stream(hw, sta, tid);
+		/* established streams are looked up without stream_lock */
+		stream_idx = pcie_tx_ampdu_idx(sta, tid);
+		if (stream_idx >= 0) {
+			if (WARN_ON(!(qos &
+				    IEEE80211_QOS_CTL_ACK_POLICY_BLOCKACK))) {
+				dev_kfree_skb_any(skb);
+				return;
+			}
 
-		if (stream) {
-			if (stream->state == AMPDU_STREAM_ACTIVE) {
-				if (WARN_ON(!(qos &
-					    IEEE80211_QOS_CTL_ACK_POLICY_BLOCKACK))) {
+			txpriority = (SYSADPT_TX_WMM_QUEUES + stream_idx) %
+				     TOTAL_HW_QUEUES;
+		} else {
+			spin_lock_bh(&priv->stream_lock);
+			stream = mwl_fwcmd_lookup_stream(hw, sta, tid);
+
+			if (stream) {
+				if (stream->state == AMPDU_STREAM_ACTIVE) {
+					if (WARN_ON(!(qos &
+						    IEEE80211_QOS_CTL_ACK_POLICY_BLOCKACK))) {
+						spin_unlock_bh(&priv->stream_lock);
+						dev_kfree_skb_any(skb);
+						return;
+					}
+
+					txpriority =
+						(SYSADPT_TX_WMM_QUEUES + stream->idx) %
+						TOTAL_HW_QUEUES;
+				} else if (stream->state == AMPDU_STREAM_NEW) {
+					/* We get here if the driver sends us packets
+					 * after we've initiated a stream, but before
+					 * our ampdu_action routine has been called
+					 * with IEEE80211_AMPDU_TX_START to get the SSN
+					 * for the ADDBA request.  So this packet can
+					 * go out with no risk of sequence number
+					 * mismatch.  No special handling is required.
+					 */
+				} else {
+					/* Drop packets that would go out after the
+					 * ADDBA request was sent but before the ADDBA
+					 * response is received.  If we don't do this,
+					 * the recipient would probably receive it
+					 * after the ADDBA request with SSN 0.  This
+					 * will cause the recipient's BA receive window
+					 * to shift, which would cause the subsequent
+					 * packets in the BA stream to be discarded.
+					 * mac80211 queues our packets for us in this
+					 * case, so this is really just a safety check.
+					 */
+					wiphy_warn(hw->wiphy,
+						   "can't send packet during ADDBA\n");
 					spin_unlock_bh(&priv->stream_lock);
 					dev_kfree_skb_any(skb);
 					return;
 				}
-
-				txpriority =
-					(SYSADPT_TX_WMM_QUEUES + stream->idx) %
-					TOTAL_HW_QUEUES;
-			} else if (stream->state == AMPDU_STREAM_NEW) {
-				/* We get here if the driver sends us packets
-				 * after we've initiated a stream, but before
-				 * our ampdu_action routine has been called
-				 * with IEEE80211_AMPDU_TX_START to get the SSN
-				 * for the ADDBA request.  So this packet can
-				 * go out with no risk of sequence number
-				 * mismatch.  No special handling is required.
-				 */
 			} else {
-				/* Drop packets that would go out after the
-				 * ADDBA request was sent but before the ADDBA
-				 * response is received.  If we don't do this,
-				 * the recipient would probably receive it
-				 * after the ADDBA request with SSN 0.  This
-				 * will cause the recipient's BA receive window
-				 * to shift, which would cause the subsequent
-				 * packets in the BA stream to be discarded.
-				 * mac80211 queues our packets for us in this
-				 * case, so this is really just a safety check.
-				 */
-				wiphy_warn(hw->wiphy,
-					   "can't send packet during ADDBA\n");
-				spin_unlock_bh(&priv->stream_lock);
-				dev_kfree_skb_any(skb);
-				return;
-			}
-		} else {
-			if (mwl_fwcmd_ampdu_allowed(sta, tid)) {
-				stream = mwl_fwcmd_add_stream(hw, sta, tid);
+				if (mwl_fwcmd_ampdu_allowed(sta, tid)) {
+					stream = mwl_fwcmd_add_stream(hw, sta, tid);
 
-				if (stream)
-					start_ba_session = true;
+					if (stream)
+						start_ba_session = true;
+				}
 			}
-		}
 
-		spin_unlock_bh(&priv->stream_lock);
+			spin_unlock_bh(&priv->stream_lock);
+		}
 	} else {
 		qos &= ~IEEE80211_QOS_CTL_ACK_POLICY_MASK;
 		qos |= IEEE80211_QOS_CTL_ACK_POLICY_NORMAL;
@@ -800,13 +821,8 @@ void pcie_8864_tx_xmit(struct ieee80211_hw *hw,
 	tx_ctrl->qos_ctrl = qos;
 	tx_ctrl->xmit_control = xmitcontrol;
 
-	if (skb_queue_len(&pcie_priv->txq[index]) > pcie_priv->txq_limit)
-		ieee80211_stop_queue(hw, SYSADPT_TX_WMM_QUEUES - index - 1);
-
 	skb_queue_tail(&pcie_priv->txq[index], skb);
 
-	tasklet_schedule(&pcie_priv->tx_task);
-
 	/* Initiate the ampdu session here */
 	if (start_ba_session) {
 		spin_lock_bh(&priv->stream_lock);
@@ -824,6 +840,27 @@ void pcie_8864_tx_xmit(struct ieee80211_hw *hw,
 	}
 }
 
+void pcie_8864_tx_xmit(struct ieee80211_hw *hw,
+		       struct ieee80211_tx_control *control,
+		       struct sk_buff *skb)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+
+	pcie_tx_enqueue(hw, control->sta, skb);
+
+	pcie_tx_schedule(pcie_priv);
+}
+
+void pcie_8864_tx_wake_queue(struct ieee80211_hw *hw,
+			     struct ieee80211_txq *txq)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+
+	pcie_tx_schedule(pcie_priv);
+}
+
 void pcie_8864_tx_del_pkts_via_vif(struct ieee80211_hw *hw,
 				   struct ieee80211_vif *vif)
 {
@@ -898,10 +935,13 @@ void pcie_8864_tx_del_ampdu_pkts(struct ieee80211_hw *hw,
 void pcie_8864_tx_del_sta_amsdu_pkts(struct ieee80211_hw *hw,
 				     struct ieee80211_sta *sta)
 {
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
 	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
 	int num;
 	struct mwl_amsdu_frag *amsdu_frag;
 
+	spin_lock_bh(&pcie_priv->tx_desc_lock);
 	spin_lock_bh(&sta_info->amsdu_lock);
 	for (num = 0; num < SYSADPT_TX_WMM_QUEUES; num++) {
 		amsdu_frag = &sta_info->amsdu_ctrl.frag[num];
@@ -910,6 +950,8 @@ void pcie_8864_tx_del_sta_amsdu_pkts(struct ieee80211_hw *hw,
 			if (amsdu_frag->skb)
 				dev_kfree_skb_any(amsdu_frag->skb);
 		}
+		list_del_init(&amsdu_frag->list);
 	}
 	spin_unlock_bh(&sta_info->amsdu_lock);
+	spin_unlock_bh(&pcie_priv->tx_desc_lock);
 }
\ No newline at end of file
@@ -26,6 +26,8 @@ void pcie_8864_tx_done_task(unsigned long data);
 void pcie_8864_tx_xmit(struct ieee80211_hw *hw,
 		       struct ieee80211_tx_control *control,
 		       struct sk_buff *skb);
+void pcie_8864_tx_wake_queue(struct ieee80211_hw *hw,
+			     struct ieee80211_txq *txq);
 void pcie_8864_tx_del_pkts_via_vif(struct ieee80211_hw *hw,
 				   struct ieee80211_vif *vif);
 void pcie_8864_tx_del_pkts_via_sta(struct ieee80211_hw *hw,
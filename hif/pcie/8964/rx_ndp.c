@@ -61,6 +61,56 @@ err_no_mem:
 	return -ENOMEM;
 }
 
+static inline void pcie_rx_refill_ndp(struct mwl_priv *priv, u32 buf_idx,
+				      struct sk_buff *psk_buff, dma_addr_t dma)
+{
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct pcie_desc_data_ndp *desc = &pcie_priv->desc_data_ndp;
+
+	desc->rx_vbuflist[buf_idx] = psk_buff;
+	desc->prx_ring[buf_idx].data = cpu_to_le32(dma);
+	__set_bit(buf_idx, desc->rx_posted);
+
+	if (IS_ENABLED(CONFIG_MWLWIFI_RX_TRACE)) {
+		*((u32 *)&psk_buff->cb[16]) = 0xdeadbeef;
+		skb_queue_tail(&pcie_priv->rx_skb_trace, psk_buff);
+	}
+}
+
+/* Take back a buffer the firmware returned, false if it was not posted.
+ * A buffer that fails the checks stays posted, so ring cleanup still
+ * frees it.
+ */
+static inline bool pcie_rx_reclaim_ndp(struct mwl_priv *priv, u32 buf_idx,
+				       struct sk_buff *psk_buff)
+{
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct pcie_desc_data_ndp *desc = &pcie_priv->desc_data_ndp;
+
+	if (!test_bit(buf_idx, desc->rx_posted)) {
+		pcie_priv->signature_err++;
+		return false;
+	}
+
+	if (IS_ENABLED(CONFIG_MWLWIFI_RX_TRACE)) {
+		if (*((u32 *)&psk_buff->cb[16]) != 0xdeadbeef) {
+			pcie_priv->signature_err++;
+			return false;
+		}
+		if (psk_buff->next && psk_buff->prev) {
+			skb_unlink(psk_buff, &pcie_priv->rx_skb_trace);
+			*((u32 *)&psk_buff->cb[16]) = 0xbeefdead;
+		} else {
+			pcie_priv->rx_skb_unlink_err++;
+			return false;
+		}
+	}
+
+	__clear_bit(buf_idx, desc->rx_posted);
+
+	return true;
+}
+
 static int pcie_rx_ring_init_ndp(struct mwl_priv *priv)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
@@ -68,39 +118,30 @@ static int pcie_rx_ring_init_ndp(struct mwl_priv *priv)
 	int i;
 	struct sk_buff *psk_buff;
 	dma_addr_t dma;
+	int rc;
 
 	skb_queue_head_init(&pcie_priv->rx_skb_trace);
+	bitmap_zero(desc->rx_posted, MAX_NUM_RX_DESC);
 	if (desc->prx_ring) {
 		desc->rx_buf_size = MAX_AGGR_SIZE;
 
+		rc = pcie_rx_pool_create(priv, MAX_NUM_RX_DESC,
+					 NET_SKB_PAD + MIN_BYTES_RX_HEADROOM,
+					 desc->rx_buf_size);
+		if (rc)
+			return rc;
+
 		for (i = 0; i < MAX_NUM_RX_DESC; i++) {
-			psk_buff = __alloc_skb(desc->rx_buf_size + NET_SKB_PAD,
-					       GFP_ATOMIC, SKB_ALLOC_RX,
-					       NUMA_NO_NODE);
-			skb_reserve(psk_buff, NET_SKB_PAD);
+			psk_buff = pcie_rx_pool_alloc_skb(pcie_priv, &dma);
 			if (!psk_buff) {
 				wiphy_err(priv->hw->wiphy,
 					  "rxdesc %i: no skbuff available\n",
 					  i);
 				return -ENOMEM;
 			}
-			skb_reserve(psk_buff, MIN_BYTES_RX_HEADROOM);
-
-			dma = dma_map_single(&(pcie_priv->pdev)->dev,
-					     psk_buff->data,
-					     desc->rx_buf_size,
-					     DMA_FROM_DEVICE);
-			if (dma_mapping_error(&(pcie_priv->pdev)->dev, dma)) {
-				wiphy_err(priv->hw->wiphy,
-					  "failed to map pci memory!\n");
-				return -ENOMEM;
-			}
 
-			desc->rx_vbuflist[i] = psk_buff;
 			desc->prx_ring[i].user = cpu_to_le32(i);
-			desc->prx_ring[i].data = cpu_to_le32(dma);
-			*((u32 *)&psk_buff->cb[16]) = 0xdeadbeef;
-			skb_queue_tail(&pcie_priv->rx_skb_trace, psk_buff);
+			pcie_rx_refill_ndp(priv, i, psk_buff, dma);
 		}
 
 		writel(1023, pcie_priv->iobase1 + MACREG_REG_RXDESCHEAD);
@@ -119,16 +160,12 @@ static void pcie_rx_ring_cleanup_ndp(struct mwl_priv *priv)
 
 	if (desc->prx_ring) {
 		for (i = 0; i < MAX_NUM_RX_DESC; i++) {
-			if (desc->rx_vbuflist[i]) {
-				dma_unmap_single(&(pcie_priv->pdev)->dev,
-						 le32_to_cpu(
-						 desc->prx_ring[i].data),
-						 desc->rx_buf_size,
-						 DMA_FROM_DEVICE);
-				desc->rx_vbuflist[i] = NULL;
-			}
+			if (desc->rx_vbuflist[i] &&
+			    __test_and_clear_bit(i, desc->rx_posted))
+				dev_kfree_skb_any(desc->rx_vbuflist[i]);
+			desc->rx_vbuflist[i] = NULL;
 		}
-		skb_queue_purge(&pcie_priv->rx_skb_trace);
+		skb_queue_head_init(&pcie_priv->rx_skb_trace);
 	}
 }
 
@@ -153,6 +190,8 @@ static void pcie_rx_ring_free_ndp(struct mwl_priv *priv)
 				  desc->pphys_rx_ring_done);
 		desc->prx_ring_done = NULL;
 	}
+
+	pcie_rx_pool_destroy(pcie_priv);
 }
 
 static inline void pcie_rx_update_ndp_cnts(struct mwl_priv *priv, u32 ctrl)
@@ -214,6 +253,17 @@ static void pcie_rx_status_ndp(struct mwl_priv *priv,
 		priv->hw->conf.chandef.chan->hw_value, status->band);
 }
 
+/* mac80211 strips exactly these encapsulations when it converts to 802.3.
+ */
+static inline bool pcie_rx_snap_ndp(const u8 *snap, u16 ethertype)
+{
+	if (!memcmp(snap, rfc1042_header, sizeof(rfc1042_header)))
+		return (ethertype != ETH_P_AARP) && (ethertype != ETH_P_IPX);
+
+	return !memcmp(snap, bridge_tunnel_header,
+		       sizeof(bridge_tunnel_header));
+}
+
 static inline void pcie_rx_process_fast_data(struct mwl_priv *priv,
 					     struct sk_buff *skb,
 					     u16 stnid)
@@ -243,6 +293,29 @@ static inline void pcie_rx_process_fast_data(struct mwl_priv *priv,
 		goto drop_packet;
 
 	ethertype = (skb->data[20] << 8) | skb->data[21];
+
+	/* Deliver as 802.3 when mac80211 enabled decap offload for this
+	 * station, WDS peers still need the 4-address header.
+	 */
+	if (sta_info->rx_decap && !sta_info->wds &&
+	    pcie_rx_snap_ndp(skb->data + ETH_HLEN, ethertype)) {
+		status = IEEE80211_SKB_RXCB(skb);
+		pcie_rx_status_ndp(priv, sta_info, status);
+		status->flag |= RX_FLAG_8023 | RX_FLAG_DUP_VALIDATED;
+		if (mwl_vif->is_hw_crypto_enabled)
+			status->flag |= RX_FLAG_IV_STRIPPED |
+					RX_FLAG_DECRYPTED |
+					RX_FLAG_MMIC_STRIPPED;
+
+		/* DA/SA move over length and SNAP (8 bytes) to sit in front
+		 * of the ethertype.
+		 */
+		memmove(skb->data + 8, skb->data, ETH_ALEN * 2);
+		skb_pull(skb, 8);
+		ieee80211_rx_napi(priv->hw, sta, skb, &pcie_priv->napi);
+		return;
+	}
+
 	fc = cpu_to_le16(IEEE80211_FTYPE_DATA | IEEE80211_STYPE_DATA);
 
 	memset(&hdr, 0, sizeof(hdr));
@@ -323,7 +396,7 @@ static inline void pcie_rx_process_fast_data(struct mwl_priv *priv,
 		memcpy(skb_push(skb, hdrlen), &hdr, hdrlen);
 
 	status->flag |= RX_FLAG_DUP_VALIDATED;
-	ieee80211_rx(priv->hw, skb);
+	ieee80211_rx_napi(priv->hw, NULL, skb, &pcie_priv->napi);
 
 	return;
 drop_packet:
@@ -335,6 +408,7 @@ static inline void pcie_rx_process_slow_data(struct mwl_priv *priv,
 					     struct sk_buff *skb,
 					     bool bad_mic, u8 signal)
 {
+	struct pcie_priv *pcie_priv = priv->hif.priv;
 	struct ieee80211_rx_status *status;
 	struct ieee80211_hdr *wh;
 	struct mwl_vif *mwl_vif = NULL;
@@ -354,6 +428,7 @@ static inline void pcie_rx_process_slow_data(struct mwl_priv *priv,
 		wh = (struct ieee80211_hdr *)skb->data;
 
 		if (ieee80211_has_protected(wh->frame_control)) {
+			rcu_read_lock();
 			if (ieee80211_has_tods(wh->frame_control)) {
 				mwl_vif = utils_find_vif_bss(priv, wh->addr1);
 				if (!mwl_vif &&
@@ -374,6 +449,7 @@ static inline void pcie_rx_process_slow_data(struct mwl_priv *priv,
 							RX_FLAG_DECRYPTED |
 							RX_FLAG_MMIC_STRIPPED;
 			}
+			rcu_read_unlock();
 		}
 
 		if (ieee80211_has_a4(wh->frame_control) && !priv->wds_check) {
@@ -387,46 +463,15 @@ static inline void pcie_rx_process_slow_data(struct mwl_priv *priv,
 			if (monitor_skb) {
 				IEEE80211_SKB_RXCB(monitor_skb)->flag |= RX_FLAG_ONLY_MONITOR;
 				((struct ieee80211_hdr *)monitor_skb->data)->frame_control &= ~__cpu_to_le16(IEEE80211_FCTL_PROTECTED);
-				ieee80211_rx(priv->hw, monitor_skb);
+				ieee80211_rx_napi(priv->hw, NULL, monitor_skb,
+						  &pcie_priv->napi);
 			}
 			status->flag |= RX_FLAG_SKIP_MONITOR;
 		}
 	}
 
 	status->flag |= RX_FLAG_DUP_VALIDATED;
-	ieee80211_rx(priv->hw, skb);
-}
-
-static inline int pcie_rx_refill_ndp(struct mwl_priv *priv, u32 buf_idx)
-{
-	struct pcie_priv *pcie_priv = priv->hif.priv;
-	struct pcie_desc_data_ndp *desc = &pcie_priv->desc_data_ndp;
-	struct sk_buff *psk_buff;
-	dma_addr_t dma;
-
-	psk_buff = __alloc_skb(desc->rx_buf_size + NET_SKB_PAD, GFP_ATOMIC,
-			       SKB_ALLOC_RX, NUMA_NO_NODE);
-	skb_reserve(psk_buff, NET_SKB_PAD);
-	if (!psk_buff)
-		return -ENOMEM;
-	skb_reserve(psk_buff, MIN_BYTES_RX_HEADROOM);
-
-	dma = dma_map_single(&(pcie_priv->pdev)->dev,
-			     psk_buff->data,
-			     desc->rx_buf_size,
-			     DMA_FROM_DEVICE);
-	if (dma_mapping_error(&(pcie_priv->pdev)->dev, dma)) {
-		wiphy_err(priv->hw->wiphy,
-			  "refill: failed to map pci memory!\n");
-		return -ENOMEM;
-	}
-
-	desc->rx_vbuflist[buf_idx] = psk_buff;
-	desc->prx_ring[buf_idx].data = cpu_to_le32(dma);
-	*((u32 *)&psk_buff->cb[16]) = 0xdeadbeef;
-	skb_queue_tail(&pcie_priv->rx_skb_trace, psk_buff);
-
-	return 0;
+	ieee80211_rx_napi(priv->hw, NULL, skb, &pcie_priv->napi);
 }
 
 int pcie_rx_init_ndp(struct ieee80211_hw *hw)
@@ -460,11 +505,11 @@ void pcie_rx_deinit_ndp(struct ieee80211_hw *hw)
 	pcie_rx_ring_free_ndp(priv);
 }
 
-void pcie_rx_recv_ndp(unsigned long data)
+int pcie_rx_poll_napi_ndp(struct napi_struct *napi, int budget)
 {
-	struct ieee80211_hw *hw = (struct ieee80211_hw *)data;
-	struct mwl_priv *priv = hw->priv;
-	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct pcie_priv *pcie_priv = container_of(napi, struct pcie_priv, napi);
+	struct mwl_priv *priv = pcie_priv->mwl_priv;
+	struct ieee80211_hw *hw = priv->hw;
 	struct pcie_desc_data_ndp *desc = &pcie_priv->desc_data_ndp;
 	struct rx_ring_done *prx_ring_done;
 	struct pcie_rx_desc_ndp *prx_desc;
@@ -472,8 +517,11 @@ void pcie_rx_recv_ndp(unsigned long data)
 	u32 rx_done_tail;
 	u32 rx_desc_head;
 	struct sk_buff *psk_buff;
+	struct sk_buff *new_skb;
+	dma_addr_t dma, new_dma;
 	u32 buf_idx;
-	u32 rx_cnt;
+	int rx_cnt;
+	bool rx_pending = false;
 	u32 ctrl, ctrl_case;
 	bool bad_mic;
 	u16 stnid;
@@ -487,15 +535,16 @@ void pcie_rx_recv_ndp(unsigned long data)
 	rx_desc_head = readl(pcie_priv->iobase1 + MACREG_REG_RXDESCHEAD);
 	rx_cnt = 0;
 
-	while ((rx_done_tail != rx_done_head) &&
-	       (rx_cnt < pcie_priv->recv_limit)) {
-recheck:
+	while ((rx_done_tail != rx_done_head) && (rx_cnt < budget)) {
 		prx_ring_done = &desc->prx_ring_done[rx_done_tail];
 		wmb(); /*Data Memory Barrier*/
 		if (le32_to_cpu(prx_ring_done->user) == 0xdeadbeef) {
+			/* Head moved before the entry landed, pick it up on
+			 * the next poll instead of spinning here.
+			 */
 			pcie_priv->recheck_rxringdone++;
-			udelay(1);
-			goto recheck;
+			rx_pending = true;
+			break;
 		}
 		buf_idx = le32_to_cpu(prx_ring_done->user) & 0x3fff;
 		prx_ring_done->user = cpu_to_le32(0xdeadbeef);
@@ -506,24 +555,28 @@ recheck:
 		psk_buff = desc->rx_vbuflist[buf_idx];
 		if (!psk_buff) {
 			wiphy_err(hw->wiphy, "RX socket buffer is NULL\n");
+			new_skb = pcie_rx_pool_alloc_skb(pcie_priv, &new_dma);
 			goto out;
 		}
-		if (*((u32 *)&psk_buff->cb[16]) != 0xdeadbeef) {
-			pcie_priv->signature_err++;
+		if (!pcie_rx_reclaim_ndp(priv, buf_idx, psk_buff))
 			break;
-		}
-		if (psk_buff->next && psk_buff->prev) {
-			skb_unlink(psk_buff, &pcie_priv->rx_skb_trace);
-			*((u32 *)&psk_buff->cb[16]) = 0xbeefdead;
-		} else {
-			pcie_priv->rx_skb_unlink_err++;
-			break;
-		}
 
-		dma_unmap_single(&(pcie_priv->pdev)->dev,
-				 le32_to_cpu(prx_desc->data),
-				 desc->rx_buf_size,
-				 DMA_FROM_DEVICE);
+		dma = le32_to_cpu(prx_desc->data);
+		new_skb = pcie_rx_pool_alloc_skb(pcie_priv, &new_dma);
+		if (unlikely(!new_skb)) {
+			/* Drop the frame and post its buffer again rather
+			 * than leave a hole in the ring.
+			 */
+			dma_sync_single_for_device(&(pcie_priv->pdev)->dev,
+						   dma, desc->rx_buf_size,
+						   DMA_FROM_DEVICE);
+			new_skb = psk_buff;
+			new_dma = dma;
+			pcie_priv->rx_pool_repost++;
+			goto out;
+		}
+		dma_sync_single_for_cpu(&(pcie_priv->pdev)->dev, dma,
+					desc->rx_buf_size, DMA_FROM_DEVICE);
 
 		bad_mic = false;
 		ctrl = le32_to_cpu(prx_ring_done->ctrl);
@@ -604,7 +657,8 @@ recheck:
 			break;
 		}
 out:
-		pcie_rx_refill_ndp(priv, buf_idx);
+		if (new_skb)
+			pcie_rx_refill_ndp(priv, buf_idx, new_skb, new_dma);
 
 		if (rx_done_tail >= MAX_RX_RING_DONE_SIZE)
 			rx_done_tail = 0;
@@ -620,6 +674,11 @@ out:
 	writel(rx_done_tail, pcie_priv->iobase1 + MACREG_REG_RXDONETAIL);
 	writel(rx_desc_head, pcie_priv->iobase1 + MACREG_REG_RXDESCHEAD);
 
-	pcie_mask_int(pcie_priv, MACREG_A2HRIC_RX_DONE_HEAD_RDY, true);
-	pcie_priv->is_rx_schedule = false;
+	if (rx_pending)
+		return budget;
+
+	if ((rx_cnt < budget) && napi_complete_done(napi, rx_cnt))
+		pcie_irq_rearm_rx(hw, rx_cnt);
+
+	return rx_cnt;
 }
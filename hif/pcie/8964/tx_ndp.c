@@ -41,6 +41,7 @@
 #define TX_CTRL_TYPE_DATA       BIT(0)
 #define TX_CTRL_EAPOL           BIT(1)
 #define TX_CTRL_TCP_ACK         BIT(2)
+#define TX_CTRL_8023            BIT(3)
 
 /* Transmission information to transmit a socket buffer.
  */
@@ -54,6 +55,10 @@ struct pcie_tx_ctrl_ndp {
 	u16 qos;
 } __packed;
 
+static void pcie_tx_enqueue_ndp(struct ieee80211_hw *hw,
+				struct ieee80211_sta *sta,
+				struct sk_buff *skb);
+
 static int pcie_tx_ring_alloc_ndp(struct mwl_priv *priv)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
@@ -101,6 +106,15 @@ err_no_mem:
 	return -ENOMEM;
 }
 
+static void pcie_tx_vbuf_reset_ndp(struct pcie_desc_data_ndp *desc)
+{
+	int i;
+
+	for (i = 0; i < MAX_TX_RING_SEND_SIZE; i++)
+		desc->tx_vbuf_free[i] = MAX_TX_RING_SEND_SIZE - 1 - i;
+	desc->tx_vbuf_free_cnt = MAX_TX_RING_SEND_SIZE;
+}
+
 static int pcie_tx_ring_init_ndp(struct mwl_priv *priv)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
@@ -110,6 +124,9 @@ static int pcie_tx_ring_init_ndp(struct mwl_priv *priv)
 	for (i = 0; i < PCIE_NUM_OF_DESC_DATA; i++)
 		skb_queue_head_init(&pcie_priv->txq[i]);
 
+	pcie_tx_vbuf_reset_ndp(desc);
+	desc->tx_vbuf_hwm = 0;
+
 	if (!desc->ptx_ring) {
 		for (i = 0; i < MAX_NUM_TX_DESC; i++)
 			desc->ptx_ring[i].user = cpu_to_le32(i);
@@ -144,7 +161,7 @@ static void pcie_tx_ring_cleanup_ndp(struct mwl_priv *priv)
 	desc->tx_sent_tail = 0;
 	desc->tx_sent_head = 0;
 	desc->tx_done_tail = 0;
-	desc->tx_vbuflist_idx = 0;
+	pcie_tx_vbuf_reset_ndp(desc);
 	desc->tx_desc_busy_cnt = 0;
 }
 
@@ -185,18 +202,51 @@ static inline u32 pcie_tx_set_skb(struct mwl_priv *priv, struct sk_buff *skb,
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 	struct pcie_desc_data_ndp *desc = &pcie_priv->desc_data_ndp;
-	u32 index = desc->tx_vbuflist_idx;
+	u32 index;
 
-	while (desc->tx_vbuflist[index])
-		index = (index + 1) % MAX_TX_RING_SEND_SIZE;
+	/* Callers keep tx_desc_busy_cnt below MAX_TX_RING_SEND_SIZE, so the
+	 * free stack is never empty here.
+	 */
+	index = desc->tx_vbuf_free[--desc->tx_vbuf_free_cnt];
+	if (MAX_TX_RING_SEND_SIZE - desc->tx_vbuf_free_cnt > desc->tx_vbuf_hwm)
+		desc->tx_vbuf_hwm = MAX_TX_RING_SEND_SIZE -
+			desc->tx_vbuf_free_cnt;
 
-	desc->tx_vbuflist_idx = (index + 1) % MAX_TX_RING_SEND_SIZE;
 	desc->pphys_tx_buflist[index] = dma;
 	desc->tx_vbuflist[index] = skb;
 
 	return index;
 }
 
+/* Turn an 802.3 frame into the SNAP payload the firmware expects after
+ * DA/SA, returns the number of bytes the frame shrank at the front.
+ */
+static inline u8 pcie_tx_8023_to_snap_ndp(struct sk_buff *skb)
+{
+	struct ethhdr *eth = (struct ethhdr *)skb->data;
+	const u8 *encaps;
+
+	if (ntohs(eth->h_proto) < ETH_P_802_3_MIN) {
+		skb_pull(skb, ETH_HLEN);
+		return ETH_HLEN;
+	}
+
+	if ((eth->h_proto == htons(ETH_P_AARP)) ||
+	    (eth->h_proto == htons(ETH_P_IPX)))
+		encaps = bridge_tunnel_header;
+	else
+		encaps = rfc1042_header;
+
+	skb_pull(skb, ETH_ALEN * 2);
+	memcpy(skb_push(skb, sizeof(rfc1042_header)), encaps,
+	       sizeof(rfc1042_header));
+
+	return ETH_ALEN * 2 - sizeof(rfc1042_header);
+}
+
+/* Fill the next TX descriptor, caller holds tx_desc_lock and publishes
+ * the new head with pcie_tx_kick_ndp() once the burst is complete.
+ */
 static inline int pcie_tx_skb_ndp(struct mwl_priv *priv,
 				  struct sk_buff *tx_skb)
 {
@@ -211,8 +261,6 @@ static inline int pcie_tx_skb_ndp(struct mwl_priv *priv,
 	u32 ctrl = 0;
 	dma_addr_t dma;
 
-	spin_lock_bh(&pcie_priv->tx_desc_lock);
-
 	tx_send_tail = desc->tx_sent_tail;
 	tx_send_head_new = desc->tx_sent_head;
 
@@ -223,17 +271,21 @@ static inline int pcie_tx_skb_ndp(struct mwl_priv *priv,
 		desc->tx_sent_tail = tx_send_tail;
 
 		if (((tx_send_head_new + 1) & (MAX_NUM_TX_DESC-1)) ==
-		    tx_send_tail) {
-			spin_unlock_bh(&pcie_priv->tx_desc_lock);
+		    tx_send_tail)
 			return -EAGAIN;
-		}
 	}
 
 	tx_info = IEEE80211_SKB_CB(tx_skb);
 	tx_ctrl = (struct pcie_tx_ctrl_ndp *)tx_info->driver_data;
 	pnext_tx_desc = &desc->ptx_ring[tx_send_head_new];
 
-	if (tx_ctrl->flags & TX_CTRL_TYPE_DATA) {
+	if (tx_ctrl->flags & TX_CTRL_8023) {
+		struct ethhdr *eth = (struct ethhdr *)tx_skb->data;
+
+		ether_addr_copy(pnext_tx_desc->u.sa, eth->h_source);
+		ether_addr_copy(pnext_tx_desc->u.da, eth->h_dest);
+		tx_ctrl->hdrlen = pcie_tx_8023_to_snap_ndp(tx_skb);
+	} else if (tx_ctrl->flags & TX_CTRL_TYPE_DATA) {
 		wh = (struct ieee80211_hdr *)tx_skb->data;
 
 		skb_pull(tx_skb, tx_ctrl->hdrlen);
@@ -241,6 +293,9 @@ static inline int pcie_tx_skb_ndp(struct mwl_priv *priv,
 				ieee80211_get_SA(wh));
 		ether_addr_copy(pnext_tx_desc->u.da,
 				ieee80211_get_DA(wh));
+	}
+
+	if (tx_ctrl->flags & TX_CTRL_TYPE_DATA) {
 
 		if (tx_ctrl->flags & TX_CTRL_EAPOL)
 			ctrl = TXRING_CTRL_TAG_EAP << TXRING_CTRL_TAG_SHIFT;
@@ -273,7 +328,6 @@ static inline int pcie_tx_skb_ndp(struct mwl_priv *priv,
 		dev_kfree_skb_any(tx_skb);
 		wiphy_err(priv->hw->wiphy,
 			  "failed to map pci memory!\n");
-		spin_unlock_bh(&pcie_priv->tx_desc_lock);
 		return -EIO;
 	}
 
@@ -283,25 +337,43 @@ static inline int pcie_tx_skb_ndp(struct mwl_priv *priv,
 
 	if ((tx_ctrl->flags & TX_CTRL_TYPE_DATA) &&
 	    (tx_ctrl->rate != 0)) {
+		/* Only the data pointer moves back, the DA of an 802.3 frame
+		 * is still intact for the station lookup on status.
+		 */
 		skb_push(tx_skb, tx_ctrl->hdrlen);
 		skb_get(tx_skb);
-		pcie_tx_prepare_info(priv, tx_ctrl->rate, tx_info);
-		tx_ctrl->flags |= TX_CTRL_TYPE_DATA;
-		ieee80211_tx_status(priv->hw, tx_skb);
+		if (tx_ctrl->flags & TX_CTRL_8023) {
+			struct ieee80211_vif *vif = tx_info->control.vif;
+
+			pcie_tx_prepare_info(priv, tx_ctrl->rate, tx_info);
+			tx_ctrl->flags |= TX_CTRL_TYPE_DATA;
+			ieee80211_tx_status_8023(priv->hw, vif, tx_skb);
+		} else {
+			pcie_tx_prepare_info(priv, tx_ctrl->rate, tx_info);
+			tx_ctrl->flags |= TX_CTRL_TYPE_DATA;
+			ieee80211_tx_status(priv->hw, tx_skb);
+		}
 	}
 
 	if (++tx_send_head_new >= MAX_NUM_TX_DESC)
 		tx_send_head_new = 0;
 	desc->tx_sent_head = tx_send_head_new;
-	wmb(); /*Data Memory Barrier*/
-	writel(tx_send_head_new, pcie_priv->iobase1 + MACREG_REG_TXSENDHEAD);
 	desc->tx_desc_busy_cnt++;
 
-	spin_unlock_bh(&pcie_priv->tx_desc_lock);
-
 	return 0;
 }
 
+static inline void pcie_tx_kick_ndp(struct mwl_priv *priv, int burst)
+{
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct pcie_desc_data_ndp *desc = &pcie_priv->desc_data_ndp;
+
+	wmb(); /*Data Memory Barrier*/
+	writel(desc->tx_sent_head, pcie_priv->iobase1 + MACREG_REG_TXSENDHEAD);
+	pcie_priv->tx_kick_cnt++;
+	pcie_priv->tx_burst_pkts += burst;
+}
+
 static inline void pcie_tx_check_tcp_ack(struct sk_buff *tx_skb,
 					 struct pcie_tx_ctrl_ndp *tx_ctrl)
 {
@@ -309,7 +381,11 @@ static inline void pcie_tx_check_tcp_ack(struct sk_buff *tx_skb,
 	struct tcphdr *tcph;
 
 	if (tx_ctrl->flags & TX_CTRL_TYPE_DATA) {
-		iph = (struct iphdr *)(tx_skb->data + tx_ctrl->hdrlen + 8);
+		if (tx_ctrl->flags & TX_CTRL_8023)
+			iph = (struct iphdr *)(tx_skb->data + ETH_HLEN);
+		else
+			iph = (struct iphdr *)(tx_skb->data +
+					       tx_ctrl->hdrlen + 8);
 		tcph = (struct tcphdr *)((u8 *)iph + (iph->ihl * 4));
 		if ((iph->protocol == IPPROTO_TCP) &&
 		    (tx_skb->protocol == htons(ETH_P_IP))) {
@@ -374,9 +450,15 @@ void pcie_tx_skbs_ndp(unsigned long data)
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 	int num = SYSADPT_TX_WMM_QUEUES;
 	struct sk_buff *tx_skb;
+	bool more = false;
+	bool pending;
+	int burst;
 	int rc;
 
 	while (num--) {
+		pending = pcie_tx_pull_txqs(hw, SYSADPT_TX_WMM_QUEUES - num - 1,
+					    pcie_tx_enqueue_ndp);
+
 		while (skb_queue_len(&pcie_priv->txq[num]) > 0) {
 			if (pcie_priv->desc_data_ndp.tx_desc_busy_cnt >=
 			    (MAX_TX_RING_SEND_SIZE - 1)) {
@@ -384,34 +466,60 @@ void pcie_tx_skbs_ndp(unsigned long data)
 				break;
 			}
 
-			tx_skb = skb_dequeue(&pcie_priv->txq[num]);
+			/* Fill up to tx_burst descriptors, then ring the
+			 * doorbell once for all of them.
+			 */
+			rc = 0;
+			burst = 0;
+			spin_lock_bh(&pcie_priv->tx_desc_lock);
+			while (burst < pcie_priv->tx_burst) {
+				if (pcie_priv->desc_data_ndp.tx_desc_busy_cnt >=
+				    (MAX_TX_RING_SEND_SIZE - 1))
+					break;
+
+				tx_skb = skb_dequeue(&pcie_priv->txq[num]);
+				if (!tx_skb)
+					break;
+
+				rc = pcie_tx_skb_ndp(priv, tx_skb);
+				if (rc) {
+					if (rc == -EAGAIN)
+						skb_queue_head(&pcie_priv->txq[num],
+							       tx_skb);
+					break;
+				}
+				burst++;
+			}
+			if (burst)
+				pcie_tx_kick_ndp(priv, burst);
+			spin_unlock_bh(&pcie_priv->tx_desc_lock);
 
-			rc = pcie_tx_skb_ndp(priv, tx_skb);
 			if (rc) {
 				pcie_tx_done_ndp(hw);
-				if (rc == -EAGAIN)
-					skb_queue_head(&pcie_priv->txq[num],
-						       tx_skb);
 				break;
 			}
 
-			if (++pcie_priv->tx_done_cnt > TXDONE_THRESHOLD) {
+			pcie_priv->tx_done_cnt += burst;
+			if (pcie_priv->tx_done_cnt > TXDONE_THRESHOLD) {
 				pcie_tx_done_ndp(hw);
 				pcie_priv->tx_done_cnt = 0;
 			}
 		}
 
-		if (skb_queue_len(&pcie_priv->txq[num]) <
-		    pcie_priv->txq_wake_threshold) {
-			int queue;
-
-			queue = SYSADPT_TX_WMM_QUEUES - num - 1;
-			if (ieee80211_queue_stopped(hw, queue))
-				ieee80211_wake_queue(hw, queue);
-		}
+		/* Frames are left behind in mac80211 and there is room to
+		 * pull them now; a queue still above the threshold is not
+		 * empty, so pcie_timer_routine_ndp() comes back for it.
+		 */
+		if (pending && (skb_queue_len(&pcie_priv->txq[num]) <
+				pcie_priv->txq_wake_threshold))
+			more = true;
 	}
 
-	pcie_priv->is_tx_schedule = false;
+	/* Frames left behind in mac80211 queues, come back for them. */
+	if (more)
+		pcie_tx_schedule(pcie_priv);
+	else
+		pcie_priv->is_tx_schedule = false;
 }
 
 void pcie_tx_done_ndp(struct ieee80211_hw *hw)
@@ -457,6 +565,7 @@ void pcie_tx_done_ndp(struct ieee80211_hw *hw)
 				 DMA_TO_DEVICE);
 		desc->pphys_tx_buflist[index] = 0;
 		desc->tx_vbuflist[index] = NULL;
+		desc->tx_vbuf_free[desc->tx_vbuf_free_cnt++] = index;
 
 		tx_info = IEEE80211_SKB_CB(skb);
 		tx_ctrl = (struct pcie_tx_ctrl_ndp *)
@@ -503,9 +612,9 @@ bypass_ack:
 	spin_unlock_bh(&pcie_priv->tx_desc_lock);
 }
 
-void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
-		      struct ieee80211_tx_control *control,
-		      struct sk_buff *skb)
+static void pcie_tx_enqueue_ndp(struct ieee80211_hw *hw,
+				struct ieee80211_sta *sta,
+				struct sk_buff *skb)
 {
 	struct mwl_priv *priv = hw->priv;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
@@ -513,7 +622,6 @@ void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
 	struct ieee80211_key_conf *k_conf;
 	struct mwl_vif *mwl_vif;
 	int index;
-	struct ieee80211_sta *sta;
 	struct mwl_sta *sta_info;
 	struct ieee80211_hdr *wh;
 	u8 *da;
@@ -525,18 +633,25 @@ void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
 	struct ieee80211_mgmt *mgmt;
 	bool eapol_frame = false;
 	bool start_ba_session = false;
+	bool encap;
 	struct pcie_tx_ctrl_ndp *tx_ctrl;
 
 	tx_info = IEEE80211_SKB_CB(skb);
+	encap = tx_info->flags & IEEE80211_TX_CTL_HW_80211_ENCAP;
 	k_conf = tx_info->control.hw_key;
 	mwl_vif = mwl_dev_get_vif(tx_info->control.vif);
 	index = skb_get_queue_mapping(skb);
-	sta = control->sta;
 	sta_info = sta ? mwl_dev_get_sta(sta) : NULL;
 
 	wh = (struct ieee80211_hdr *)skb->data;
 
-	if (ieee80211_is_data_qos(wh->frame_control))
+	if (encap) {
+		/* 802.3 frames only go to authorized unicast peers. */
+		if (sta && sta->wme)
+			qos = skb->priority & IEEE80211_QOS_CTL_TAG1D_MASK;
+		else
+			qos = 0xFFFF;
+	} else if (ieee80211_is_data_qos(wh->frame_control))
 		qos = le16_to_cpu(*((__le16 *)ieee80211_get_qos_ctl(wh)));
 	else
 		qos = 0xFFFF;
@@ -546,7 +661,7 @@ void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
 		eapol_frame = true;
 	}
 
-	if (ieee80211_is_mgmt(wh->frame_control)) {
+	if (!encap && ieee80211_is_mgmt(wh->frame_control)) {
 		mgmtframe = true;
 		mgmt = (struct ieee80211_mgmt *)skb->data;
 	}
@@ -626,7 +741,10 @@ void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
 			spin_unlock_bh(&priv->stream_lock);
 		}
 
-		da = ieee80211_get_DA(wh);
+		if (encap)
+			da = ((struct ethhdr *)skb->data)->h_dest;
+		else
+			da = ieee80211_get_DA(wh);
 
 		if (is_multicast_ether_addr(da)
 		    && (mwl_vif->macid != SYSADPT_NUM_OF_AP)) {
@@ -636,7 +754,7 @@ void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
 			if (da[ETH_ALEN - 1] == 0xff)
 				tx_que_priority += 7;
 
-			if (ieee80211_has_a4(wh->frame_control)) {
+			if (!encap && ieee80211_has_a4(wh->frame_control)) {
 				if (sta && sta_info->wds)
 					tx_que_priority = SYSADPT_MAX_TID *
 						(sta_info->stnid +
@@ -663,29 +781,23 @@ void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
 
 	tx_ctrl = (struct pcie_tx_ctrl_ndp *)tx_info->driver_data;
 	tx_ctrl->tx_que_priority = tx_que_priority;
-	tx_ctrl->hdrlen = ieee80211_hdrlen(wh->frame_control);
+	tx_ctrl->hdrlen = encap ? 0 : ieee80211_hdrlen(wh->frame_control);
 	tx_ctrl->flags = 0;
 	tx_ctrl->qos = qos;
 	if (!mgmtframe)
 		tx_ctrl->flags |= TX_CTRL_TYPE_DATA;
 	if (eapol_frame)
 		tx_ctrl->flags |= TX_CTRL_EAPOL;
+	if (encap)
+		tx_ctrl->flags |= TX_CTRL_8023;
 	tx_ctrl->rate = sta ? sta_info->tx_rate_info : 0;
-	if (ieee80211_is_nullfunc(wh->frame_control) ||
-	    ieee80211_is_qos_nullfunc(wh->frame_control))
+	if (!encap && (ieee80211_is_nullfunc(wh->frame_control) ||
+		       ieee80211_is_qos_nullfunc(wh->frame_control)))
 		tx_ctrl->rate = 0;
 	pcie_tx_check_tcp_ack(skb, tx_ctrl);
 
-	if (skb_queue_len(&pcie_priv->txq[index]) > pcie_priv->txq_limit)
-		ieee80211_stop_queue(hw, SYSADPT_TX_WMM_QUEUES - index - 1);
-
 	skb_queue_tail(&pcie_priv->txq[index], skb);
 
-	if (!pcie_priv->is_tx_schedule) {
-		tasklet_schedule(&pcie_priv->tx_task);
-		pcie_priv->is_tx_schedule = true;
-	}
-
 	/* Initiate the ampdu session here */
 	if (start_ba_session) {
 		spin_lock_bh(&priv->stream_lock);
@@ -697,3 +809,30 @@ void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
 		spin_unlock_bh(&priv->stream_lock);
 	}
 }
+
+void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
+		      struct ieee80211_tx_control *control,
+		      struct sk_buff *skb)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+
+	pcie_tx_enqueue_ndp(hw, control->sta, skb);
+
+	if (!pcie_priv->is_tx_schedule) {
+		pcie_tx_schedule(pcie_priv);
+		pcie_priv->is_tx_schedule = true;
+	}
+}
+
+void pcie_tx_wake_queue_ndp(struct ieee80211_hw *hw,
+			    struct ieee80211_txq *txq)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+
+	if (!pcie_priv->is_tx_schedule) {
+		pcie_tx_schedule(pcie_priv);
+		pcie_priv->is_tx_schedule = true;
+	}
+}
@@ -26,5 +26,7 @@ void pcie_tx_done_ndp(struct ieee80211_hw *hw);
 void pcie_tx_xmit_ndp(struct ieee80211_hw *hw,
 		      struct ieee80211_tx_control *control,
 		      struct sk_buff *skb);
+void pcie_tx_wake_queue_ndp(struct ieee80211_hw *hw,
+			    struct ieee80211_txq *txq);
 
 #endif /* _TX_NDP_H_ */
@@ -38,6 +38,11 @@
 
 #define W836X_RSSI_OFFSET       8
 
+/* A-MSDU subframe bytes copied behind the 802.11 header, the rest of the
+ * payload stays in the receive buffer and is attached as a page fragment.
+ */
+#define RX_AMSDU_COPY_LEN       64
+
 static int pcie_rx_ring_alloc(struct mwl_priv *priv)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
@@ -79,16 +84,23 @@ static int pcie_rx_ring_init(struct mwl_priv *priv)
 	struct pcie_rx_hndl *rx_hndl;
 	dma_addr_t dma;
 	u32 val;
+	int rc;
 
 	desc = &pcie_priv->desc_data[0];
 
 	if (desc->prx_ring) {
 		desc->rx_buf_size = SYSADPT_MAX_AGGR_SIZE;
 
+		rc = pcie_rx_pool_create(priv, PCIE_MAX_NUM_RX_DESC,
+					 NET_SKB_PAD + PCIE_MIN_BYTES_HEADROOM,
+					 desc->rx_buf_size);
+		if (rc)
+			return rc;
+
 		for (i = 0; i < PCIE_MAX_NUM_RX_DESC; i++) {
 			rx_hndl = &desc->rx_hndl[i];
 			rx_hndl->psk_buff =
-				dev_alloc_skb(desc->rx_buf_size);
+				pcie_rx_pool_alloc_skb(pcie_priv, &dma);
 
 			if (!rx_hndl->psk_buff) {
 				wiphy_err(priv->hw->wiphy,
@@ -97,8 +109,6 @@ static int pcie_rx_ring_init(struct mwl_priv *priv)
 				return -ENOMEM;
 			}
 
-			skb_reserve(rx_hndl->psk_buff,
-				    PCIE_MIN_BYTES_HEADROOM);
 			desc->prx_ring[i].rx_control =
 				EAGLE_RXD_CTRL_DRIVER_OWN;
 			desc->prx_ring[i].status = EAGLE_RXD_STATUS_OK;
@@ -107,15 +117,6 @@ static int pcie_rx_ring_init(struct mwl_priv *priv)
 			desc->prx_ring[i].rssi = 0x00;
 			desc->prx_ring[i].pkt_len =
 				cpu_to_le16(SYSADPT_MAX_AGGR_SIZE);
-			dma = dma_map_single(&(pcie_priv->pdev)->dev,
-					     rx_hndl->psk_buff->data,
-					     desc->rx_buf_size,
-					     DMA_FROM_DEVICE);
-			if (dma_mapping_error(&(pcie_priv->pdev)->dev, dma)) {
-				wiphy_err(priv->hw->wiphy,
-					  "failed to map pci memory!\n");
-				return -ENOMEM;
-			}
 			desc->prx_ring[i].pphys_buff_data = cpu_to_le32(dma);
 			val = (u32)desc->pphys_rx_ring +
 			      ((i + 1) * sizeof(struct pcie_rx_desc));
@@ -153,21 +154,14 @@ static void pcie_rx_ring_cleanup(struct mwl_priv *priv)
 			if (!rx_hndl->psk_buff)
 				continue;
 
-			dma_unmap_single(&(pcie_priv->pdev)->dev,
-					 le32_to_cpu
-					 (rx_hndl->pdesc->pphys_buff_data),
-					 desc->rx_buf_size,
-					 DMA_FROM_DEVICE);
-
-			dev_kfree_skb_any(rx_hndl->psk_buff);
-
 			wiphy_debug(priv->hw->wiphy,
-				    "unmapped+free'd %i 0x%p 0x%x %i\n",
+				    "free'd %i 0x%p 0x%x %i\n",
 				    i, rx_hndl->psk_buff->data,
 				    le32_to_cpu(
 				    rx_hndl->pdesc->pphys_buff_data),
 				    desc->rx_buf_size);
 
+			dev_kfree_skb_any(rx_hndl->psk_buff);
 			rx_hndl->psk_buff = NULL;
 		}
 	}
@@ -191,6 +185,8 @@ static void pcie_rx_ring_free(struct mwl_priv *priv)
 		desc->prx_ring = NULL;
 	}
 
+	pcie_rx_pool_destroy(pcie_priv);
+
 	kfree(desc->rx_hndl);
 
 	desc->pnext_rx_hndl = NULL;
@@ -251,8 +247,10 @@ static inline int pcie_rx_process_amsdu(struct mwl_priv *priv,
 	u8 pad;
 	u8 *data;
 	u16 frame_len;
+	u16 copy_len;
+	u8 *payload;
 	struct sk_buff *newskb;
-	int work_done;
+	int work_done = 0;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 
 	wh = (struct ieee80211_hdr *)skb->data;
@@ -275,18 +273,28 @@ static inline int pcie_rx_process_amsdu(struct mwl_priv *priv,
 		if ((len + ETH_HLEN + frame_len) > skb->len)
 			break;
 
-		newskb = dev_alloc_skb(wh_len + frame_len);
+		pad = ((ETH_HLEN + frame_len) % 4) ?
+			(4 - (ETH_HLEN + frame_len) % 4) : 0;
+
+		if (PCIE_RX_POOL_SHARED_PAGES)
+			copy_len = min_t(u16, frame_len, RX_AMSDU_COPY_LEN);
+		else
+			copy_len = frame_len;
+		newskb = napi_alloc_skb(&pcie_priv->napi, wh_len + copy_len);
 		if (!newskb)
 			break;
 
 		ether_addr_copy(wh->addr3, data + len);
 		ether_addr_copy(wh->addr4, data + len + ETH_ALEN);
-		memcpy(newskb->data, wh, wh_len);
-		memcpy(newskb->data + wh_len, data + len + ETH_HLEN, frame_len);
-		skb_put(newskb, wh_len + frame_len);
+		skb_put_data(newskb, wh, wh_len);
+		skb_put_data(newskb, data + len + ETH_HLEN, copy_len);
+		if (frame_len > copy_len) {
+			payload = data + len + ETH_HLEN + copy_len;
+			pcie_rx_pool_add_frag(pcie_priv, skb, newskb, payload,
+					      frame_len - copy_len,
+					      ETH_HLEN + frame_len + pad);
+		}
 
-		pad = ((ETH_HLEN + frame_len) % 4) ?
-			(4 - (ETH_HLEN + frame_len) % 4) : 0;
 		len += (ETH_HLEN + frame_len + pad);
 		if (len < skb->len)
 			status->flag |= RX_FLAG_AMSDU_MORE;
@@ -312,42 +320,23 @@ static inline int pcie_rx_process_amsdu(struct mwl_priv *priv,
 	return work_done;
 }
 
-static inline int pcie_rx_refill(struct mwl_priv *priv,
-				 struct pcie_rx_hndl *rx_hndl)
+static inline void pcie_rx_refill(struct mwl_priv *priv,
+				  struct pcie_rx_hndl *rx_hndl,
+				  struct sk_buff *skb, dma_addr_t dma)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 	struct pcie_desc_data *desc;
-	dma_addr_t dma;
 
 	desc = &pcie_priv->desc_data[0];
 
-	rx_hndl->psk_buff = dev_alloc_skb(desc->rx_buf_size);
-
-	if (!rx_hndl->psk_buff)
-		return -ENOMEM;
-
-	skb_reserve(rx_hndl->psk_buff, PCIE_MIN_BYTES_HEADROOM);
+	rx_hndl->psk_buff = skb;
 
 	rx_hndl->pdesc->status = EAGLE_RXD_STATUS_OK;
 	rx_hndl->pdesc->qos_ctrl = 0x0000;
 	rx_hndl->pdesc->channel = 0x00;
 	rx_hndl->pdesc->rssi = 0x00;
 	rx_hndl->pdesc->pkt_len = cpu_to_le16(desc->rx_buf_size);
-
-	dma = dma_map_single(&(pcie_priv->pdev)->dev,
-			     rx_hndl->psk_buff->data,
-			     desc->rx_buf_size,
-			     DMA_FROM_DEVICE);
-	if (dma_mapping_error(&(pcie_priv->pdev)->dev, dma)) {
-		dev_kfree_skb_any(rx_hndl->psk_buff);
-		wiphy_err(priv->hw->wiphy,
-			  "failed to map pci memory!\n");
-		return -ENOMEM;
-	}
-
 	rx_hndl->pdesc->pphys_buff_data = cpu_to_le32(dma);
-
-	return 0;
 }
 
 int pcie_8997_rx_init(struct ieee80211_hw *hw)
@@ -389,6 +378,8 @@ int pcie_8997_poll_napi(struct napi_struct *napi, int budget)
 	struct pcie_rx_hndl *curr_hndl;
 	int work_done = 0;
 	struct sk_buff *prx_skb = NULL;
+	struct sk_buff *new_skb;
+	dma_addr_t dma, new_dma;
 	struct sk_buff *monitor_skb;
 	int pkt_len;
 	struct ieee80211_rx_status *status;
@@ -407,13 +398,25 @@ int pcie_8997_poll_napi(struct napi_struct *napi, int budget)
 
 	while ((curr_hndl->pdesc->rx_control == EAGLE_RXD_CTRL_DMA_OWN) &&
 	       (work_done < budget)) {
+		new_skb = pcie_rx_pool_alloc_skb(pcie_priv, &new_dma);
 		prx_skb = curr_hndl->psk_buff;
 		if (unlikely(!prx_skb))
 			goto out;
-		dma_unmap_single(&(pcie_priv->pdev)->dev,
-				 le32_to_cpu(curr_hndl->pdesc->pphys_buff_data),
-				 desc->rx_buf_size,
-				 DMA_FROM_DEVICE);
+		dma = le32_to_cpu(curr_hndl->pdesc->pphys_buff_data);
+		if (unlikely(!new_skb)) {
+			/* Drop the frame and post its buffer again rather
+			 * than leave the descriptor without one.
+			 */
+			dma_sync_single_for_device(&(pcie_priv->pdev)->dev,
+						   dma, desc->rx_buf_size,
+						   DMA_FROM_DEVICE);
+			new_skb = prx_skb;
+			new_dma = dma;
+			pcie_priv->rx_pool_repost++;
+			goto out;
+		}
+		dma_sync_single_for_cpu(&(pcie_priv->pdev)->dev, dma,
+					desc->rx_buf_size, DMA_FROM_DEVICE);
 		pkt_len = le16_to_cpu(curr_hndl->pdesc->pkt_len);
 
 		if (unlikely(skb_tailroom(prx_skb) < pkt_len)) {
@@ -497,7 +500,8 @@ int pcie_8997_poll_napi(struct napi_struct *napi, int budget)
 
 		ieee80211_rx_napi(hw, NULL, prx_skb, &pcie_priv->napi);
 out:
-		pcie_rx_refill(priv, curr_hndl);
+		if (new_skb)
+			pcie_rx_refill(priv, curr_hndl, new_skb, new_dma);
 		curr_hndl->pdesc->rx_control = EAGLE_RXD_CTRL_DRIVER_OWN;
 		curr_hndl->pdesc->qos_ctrl = 0;
 		curr_hndl = curr_hndl->pnext;
@@ -509,7 +513,7 @@ out:
 end_poll:
 	if (work_done < budget) {
 		napi_complete(napi);
-		priv->hif.ops->irq_enable(hw);
+		pcie_irq_rearm_rx(hw, work_done);
 	}
 	return work_done;
 }
@@ -48,6 +48,10 @@ struct pcie_tx_ctrl {
 	u8 xmit_control;
 };
 
+static void pcie_tx_enqueue(struct ieee80211_hw *hw,
+			    struct ieee80211_sta *sta,
+			    struct sk_buff *skb);
+
 static int pcie_txbd_ring_create(struct mwl_priv *priv)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
@@ -107,6 +111,8 @@ static void pcie_tx_ring_init(struct mwl_priv *priv)
 	for (num = 0; num < PCIE_NUM_OF_DESC_DATA; num++)
 		skb_queue_head_init(&pcie_priv->txq[num]);
 
+	for (num = 0; num < SYSADPT_TX_WMM_QUEUES; num++)
+		INIT_LIST_HEAD(&pcie_priv->amsdu_pend[num]);
 }
 
 static void pcie_tx_ring_cleanup(struct mwl_priv *priv)
@@ -155,13 +161,62 @@ static void pcie_txbd_ring_delete(struct mwl_priv *priv)
 	pcie_priv->txbd_ring_pbase = 0;
 }
 
-static inline bool pcie_tx_available(struct mwl_priv *priv)
+static inline bool pcie_tx_available(struct mwl_priv *priv, int bds)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
+	u32 wr, rd, used;
+
+	if (bds == 1)
+		return PCIE_TXBD_NOT_FULL(pcie_priv->txbd_wrptr,
+					  pcie_priv->txbd_rdptr);
+
+	wr = (pcie_priv->txbd_wrptr & PCIE_TXBD_MASK) >> PCIE_TX_START_PTR;
+	rd = (pcie_priv->txbd_rdptr & PCIE_TXBD_MASK) >> PCIE_TX_START_PTR;
+	if ((pcie_priv->txbd_wrptr ^ pcie_priv->txbd_rdptr) &
+	    PCIE_BD_FLAG_TX_ROLLOVER_IND)
+		used = wr + PCIE_MAX_TXRX_BD - rd;
+	else
+		used = wr - rd;
+
+	return (PCIE_MAX_TXRX_BD - used) >= bds;
+}
+
+/* Number of TXBDs needed by an skb, zero copy A-MSDUs use one per MSDU. */
+static inline int pcie_tx_skb_bds(struct sk_buff *skb)
+{
+	struct sk_buff *frag;
+	int bds = 1;
 
-	return PCIE_TXBD_NOT_FULL(pcie_priv->txbd_wrptr,
-				  pcie_priv->txbd_rdptr);
+	skb_walk_frags(skb, frag)
+		bds++;
 
+	return bds;
+}
+
+static inline void pcie_tx_set_bd(struct mwl_priv *priv,
+				  struct sk_buff *skb, dma_addr_t dma,
+				  u16 frag_len, u16 len, u16 flags)
+{
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	const u32 num_tx_buffs = PCIE_MAX_TXRX_BD << PCIE_TX_START_PTR;
+	struct pcie_data_buf *data_buf;
+	u32 wrindx;
+
+	wrindx = (pcie_priv->txbd_wrptr & PCIE_TXBD_MASK) >>
+		PCIE_TX_START_PTR;
+	pcie_priv->tx_buf_list[wrindx] = skb;
+	data_buf = pcie_priv->txbd_ring[wrindx];
+	data_buf->paddr = cpu_to_le64(dma);
+	data_buf->len = cpu_to_le16(len);
+	data_buf->flags = cpu_to_le16(flags);
+	data_buf->frag_len = cpu_to_le16(frag_len);
+	data_buf->offset = 0;
+	pcie_priv->txbd_wrptr += PCIE_BD_FLAG_TX_START_PTR;
+
+	if ((pcie_priv->txbd_wrptr & PCIE_TXBD_MASK) == num_tx_buffs)
+		pcie_priv->txbd_wrptr = ((pcie_priv->txbd_wrptr &
+		PCIE_BD_FLAG_TX_ROLLOVER_IND) ^
+		PCIE_BD_FLAG_TX_ROLLOVER_IND);
 }
 
 static inline void pcie_tx_skb(struct mwl_priv *priv,
@@ -177,9 +232,10 @@ static inline void pcie_tx_skb(struct mwl_priv *priv,
 	dma_addr_t dma;
 	int tailpad = 0;
 	struct ieee80211_key_conf * k_conf;
-	u32 wrindx;
-	struct pcie_data_buf *data_buf;
-	const u32 num_tx_buffs = PCIE_MAX_TXRX_BD << PCIE_TX_START_PTR;
+	struct sk_buff *frag;
+	dma_addr_t frag_dma[PCIE_TX_AMSDU_ZC_MAX_SEGS];
+	int nfrags = 0;
+	int i;
 
 	tx_info = IEEE80211_SKB_CB(tx_skb);
 	tx_ctrl = (struct pcie_tx_ctrl *)tx_info->driver_data;
@@ -214,34 +270,52 @@ static inline void pcie_tx_skb(struct mwl_priv *priv,
 	tx_desc->xmit_control = tx_ctrl->xmit_control;
 	tx_desc->sap_pkt_info = 0;
 	dma = dma_map_single(&(pcie_priv->pdev)->dev, tx_skb->data,
-			     tx_skb->len, DMA_TO_DEVICE);
+			     skb_headlen(tx_skb), DMA_TO_DEVICE);
 	if (dma_mapping_error(&(pcie_priv->pdev)->dev, dma)) {
 		dev_kfree_skb_any(tx_skb);
 		wiphy_err(priv->hw->wiphy,
 			  "failed to map pci memory!\n");
 		return;
 	}
+	skb_walk_frags(tx_skb, frag) {
+		frag_dma[nfrags] = dma_map_single(&(pcie_priv->pdev)->dev,
+						  frag->data, frag->len,
+						  DMA_TO_DEVICE);
+		if (dma_mapping_error(&(pcie_priv->pdev)->dev,
+				      frag_dma[nfrags])) {
+			dma_unmap_single(&(pcie_priv->pdev)->dev, dma,
+					 skb_headlen(tx_skb), DMA_TO_DEVICE);
+			for (i = 0, frag = skb_shinfo(tx_skb)->frag_list;
+			     i < nfrags; i++, frag = frag->next)
+				dma_unmap_single(&(pcie_priv->pdev)->dev,
+						 frag_dma[i], frag->len,
+						 DMA_TO_DEVICE);
+			dev_kfree_skb_any(tx_skb);
+			wiphy_err(priv->hw->wiphy,
+				  "failed to map pci memory!\n");
+			return;
+		}
+		nfrags++;
+	}
 	tx_desc->pkt_ptr = cpu_to_le32(sizeof(struct pcie_tx_desc));
 	tx_desc->status = cpu_to_le32(EAGLE_TXD_STATUS_FW_OWNED);
 	/* make sure all the memory transactions done by cpu were completed */
 	wmb();	/*Data Memory Barrier*/
 
-	wrindx = (pcie_priv->txbd_wrptr & PCIE_TXBD_MASK) >>
-		PCIE_TX_START_PTR;
-	pcie_priv->tx_buf_list[wrindx] = tx_skb;
-	data_buf = pcie_priv->txbd_ring[wrindx];
-	data_buf->paddr = cpu_to_le64(dma);
-	data_buf->len = cpu_to_le16(tx_skb->len);
-	data_buf->flags = cpu_to_le16(PCIE_BD_FLAG_FIRST_DESC |
-					PCIE_BD_FLAG_LAST_DESC);
-	data_buf->frag_len = cpu_to_le16(tx_skb->len);
-	data_buf->offset = 0;
-	pcie_priv->txbd_wrptr += PCIE_BD_FLAG_TX_START_PTR;
-
-	if ((pcie_priv->txbd_wrptr & PCIE_TXBD_MASK) == num_tx_buffs)
-		pcie_priv->txbd_wrptr = ((pcie_priv->txbd_wrptr &
-		PCIE_BD_FLAG_TX_ROLLOVER_IND) ^
-		PCIE_BD_FLAG_TX_ROLLOVER_IND);
+	/* The skb is kept on its last TXBD so that it is only completed
+	 * once all of its pieces have been fetched.
+	 */
+	pcie_tx_set_bd(priv, nfrags ? NULL : tx_skb, dma,
+		       skb_headlen(tx_skb), tx_skb->len,
+		       PCIE_BD_FLAG_FIRST_DESC |
+		       (nfrags ? 0 : PCIE_BD_FLAG_LAST_DESC));
+	i = 0;
+	skb_walk_frags(tx_skb, frag) {
+		i++;
+		pcie_tx_set_bd(priv, (i == nfrags) ? tx_skb : NULL,
+			       frag_dma[i - 1], frag->len, tx_skb->len,
+			       (i == nfrags) ? PCIE_BD_FLAG_LAST_DESC : 0);
+	}
 
 	/* Write the TX ring write pointer in to REG_TXBD_WRPTR */
 	writel(pcie_priv->txbd_wrptr,
@@ -249,6 +323,79 @@ static inline void pcie_tx_skb(struct mwl_priv *priv,
 
 }
 
+static inline void pcie_tx_amsdu_subhdr(struct mwl_sta *sta_info,
+					struct ieee80211_hdr *wh,
+					u16 len, u8 *data)
+{
+	if (sta_info->is_mesh_node) {
+		ether_addr_copy(data, wh->addr3);
+		ether_addr_copy(data + ETH_ALEN, wh->addr4);
+	} else {
+		ether_addr_copy(data, ieee80211_get_DA(wh));
+		ether_addr_copy(data + ETH_ALEN, ieee80211_get_SA(wh));
+	}
+	*(u8 *)(data + ETH_HLEN - 1) = len & 0xff;
+	*(u8 *)(data + ETH_HLEN - 2) = (len >> 8) & 0xff;
+}
+
+static inline void pcie_tx_amsdu_flush(struct mwl_priv *priv,
+				       int desc_num,
+				       struct mwl_amsdu_frag *amsdu)
+{
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+
+	if (pcie_tx_available(priv, pcie_tx_skb_bds(amsdu->skb)))
+		pcie_tx_skb(priv, amsdu->skb);
+	else
+		skb_queue_head(&pcie_priv->txq[desc_num], amsdu->skb);
+	amsdu->num = 0;
+}
+
+/* Zero copy aggregation: the first MSDU becomes the A-MSDU head and the
+ * following MSDUs are chained on its frag_list with their subframe header
+ * written in place, pcie_tx_skb() then gives each piece its own TXBD.
+ */
+static inline void pcie_tx_amsdu_chain(struct mwl_sta *sta_info,
+				       struct mwl_amsdu_frag *amsdu,
+				       struct sk_buff *tx_skb,
+				       int wh_len, int iv_len, u16 len)
+{
+	struct ieee80211_hdr *wh = (struct ieee80211_hdr *)tx_skb->data;
+	struct sk_buff *head = amsdu->skb;
+	u8 subhdr[ETH_HLEN];
+	u8 *data;
+
+	if (amsdu->num == 0) {
+		/* Headroom was checked by the caller. */
+		skb_push(tx_skb, ETH_HLEN);
+		memmove(tx_skb->data, tx_skb->data + ETH_HLEN, wh_len + iv_len);
+		wh = (struct ieee80211_hdr *)tx_skb->data;
+		pcie_tx_amsdu_subhdr(sta_info, wh, len,
+				     tx_skb->data + wh_len + iv_len);
+		amsdu->skb = tx_skb;
+		amsdu->tail = NULL;
+		return;
+	}
+
+	/* The 802.11 header is overwritten below, build the subframe
+	 * header before pulling it off.
+	 */
+	pcie_tx_amsdu_subhdr(sta_info, wh, len, subhdr);
+	skb_pull(tx_skb, wh_len + iv_len);
+	data = skb_push(tx_skb, ETH_HLEN + amsdu->pad);
+	memset(data, 0, amsdu->pad);
+	memcpy(data + amsdu->pad, subhdr, ETH_HLEN);
+
+	if (amsdu->tail)
+		amsdu->tail->next = tx_skb;
+	else
+		skb_shinfo(head)->frag_list = tx_skb;
+	amsdu->tail = tx_skb;
+	head->len += tx_skb->len;
+	head->data_len += tx_skb->len;
+	head->truesize += tx_skb->truesize;
+}
+
 static inline
 struct sk_buff *pcie_tx_do_amsdu(struct mwl_priv *priv,
 				 int desc_num,
@@ -266,6 +413,7 @@ struct sk_buff *pcie_tx_do_amsdu(struct mwl_priv *priv,
 	u16 len;
 	u8 *data;
 	int iv_len = 0;
+	bool zc = priv->tx_amsdu_zc;
 
 	sta = (struct ieee80211_sta *)tx_ctrl->sta;
 	sta_info = mwl_dev_get_sta(sta);
@@ -276,6 +424,14 @@ struct sk_buff *pcie_tx_do_amsdu(struct mwl_priv *priv,
 	if (tx_skb->len > SYSADPT_AMSDU_ALLOW_SIZE)
 		return tx_skb;
 
+	/* Already built A-MSDU put back to the queue. */
+	if (tx_ctrl->qos_ctrl & IEEE80211_QOS_CTL_A_MSDU_PRESENT)
+		return tx_skb;
+
+	if (zc && (skb_is_nonlinear(tx_skb) ||
+		   skb_headroom(tx_skb) < ETH_HLEN))
+		return tx_skb;
+
 	/* potential amsdu size, should add amsdu header 14 bytes +
 	 * maximum padding 3.
 	 */
@@ -298,10 +454,22 @@ struct sk_buff *pcie_tx_do_amsdu(struct mwl_priv *priv,
 	amsdu = &sta_info->amsdu_ctrl.frag[desc_num];
 
 	if (amsdu->num) {
-		if ((amsdu->skb->len + amsdu->pad + len + ETH_HLEN) > sta_info->amsdu_ctrl.amsdu_allow_size) {
-			pcie_tx_skb(priv, amsdu->skb);
-			amsdu->num = 0;
+		if (((amsdu->skb->len + amsdu->pad + len + ETH_HLEN) >
+		     sta_info->amsdu_ctrl.amsdu_allow_size) ||
+		    amsdu->zc != zc ||
+		    (zc && amsdu->num >= PCIE_TX_AMSDU_ZC_MAX_SEGS))
+			pcie_tx_amsdu_flush(priv, desc_num, amsdu);
+	}
+
+	if (zc) {
+		if (amsdu->num == 0) {
+			tx_ctrl->qos_ctrl |= IEEE80211_QOS_CTL_A_MSDU_PRESENT;
+			amsdu->zc = true;
+			priv->amsdu_stats.aggr++;
 		}
+		pcie_tx_amsdu_chain(sta_info, amsdu, tx_skb,
+				    wh_len, iv_len, len);
+		goto out;
 	}
 
 	if (amsdu->num == 0) {
@@ -320,32 +488,32 @@ struct sk_buff *pcie_tx_do_amsdu(struct mwl_priv *priv,
 				    (pcie_priv->tx_head_room - headroom));
 
 		skb_put_data(amsdu->skb, tx_skb->data, wh_len + iv_len);
+		priv->amsdu_stats.copy_bytes += wh_len + iv_len;
 
 		tx_ctrl->qos_ctrl |= IEEE80211_QOS_CTL_A_MSDU_PRESENT;
 		amsdu_info = IEEE80211_SKB_CB(amsdu->skb);
 		memcpy(amsdu_info, tx_info, sizeof(*tx_info));
+		amsdu->zc = false;
+		priv->amsdu_stats.aggr++;
 	} else if (amsdu->pad)
 			skb_put_zero(amsdu->skb, amsdu->pad);
 
 	/* Prepare MSDU DATA */
 	data = amsdu->skb->data + amsdu->skb->len;
 	skb_put(amsdu->skb, ETH_HLEN);
-
-	if (sta_info->is_mesh_node) {
-		ether_addr_copy(data, wh->addr3);
-		ether_addr_copy(data + ETH_ALEN, wh->addr4);
-	} else {
-		ether_addr_copy(data, ieee80211_get_DA(wh));
-		ether_addr_copy(data + ETH_ALEN, ieee80211_get_SA(wh));
-	}
-	*(u8 *)(data + ETH_HLEN - 1) = len & 0xff;
-	*(u8 *)(data + ETH_HLEN - 2) = (len >> 8) & 0xff;
+	pcie_tx_amsdu_subhdr(sta_info, wh, len, data);
 
 	skb_put_data(amsdu->skb, tx_skb->data + wh_len + iv_len, len);
+	priv->amsdu_stats.copy_bytes += len;
+	dev_kfree_skb_any(tx_skb);
 
+out:
+	if (list_empty(&amsdu->list))
+		list_add_tail(&amsdu->list, &pcie_priv->amsdu_pend[desc_num]);
 	amsdu->num++;
 	amsdu->pad = ((len + ETH_HLEN) % 4) ? (4 - (len + ETH_HLEN) % 4) : 0;
-	dev_kfree_skb_any(tx_skb);
+	priv->amsdu_stats.msdus++;
+	priv->amsdu_stats.bytes += len;
 	if (amsdu->num > SYSADPT_AMSDU_FRAGMENT_THRESHOLD) {
 		amsdu->num = 0;
 		spin_unlock_bh(&sta_info->amsdu_lock);
@@ -356,7 +524,6 @@ struct sk_buff *pcie_tx_do_amsdu(struct mwl_priv *priv,
 	return NULL;
 }
 
-
 static void pcie_pfu_tx_done(struct mwl_priv *priv)
 {
 	struct pcie_priv *pcie_priv = priv->hif.priv;
@@ -388,14 +555,15 @@ static void pcie_pfu_tx_done(struct mwl_priv *priv)
 
 		data_buf = pcie_priv->txbd_ring[wrdoneidx];
 		done_skb = pcie_priv->tx_buf_list[wrdoneidx];
+		if (data_buf->paddr)
+			dma_unmap_single(&(pcie_priv->pdev)->dev,
+					 le64_to_cpu(data_buf->paddr),
+					 le16_to_cpu(data_buf->frag_len),
+					 DMA_TO_DEVICE);
 		if (done_skb) {
 			pfu_dma = (struct pcie_pfu_dma_data *)done_skb->data;
 			tx_desc = &pfu_dma->tx_desc;
 			dma_data = &pfu_dma->dma_data;
-			dma_unmap_single(&(pcie_priv->pdev)->dev,
-					 le32_to_cpu(data_buf->paddr),
-					 le16_to_cpu(data_buf->len),
-					 DMA_TO_DEVICE);
 			tx_desc->pkt_ptr = 0;
 			tx_desc->pkt_len = 0;
 			tx_desc->status = cpu_to_le32(EAGLE_TXD_STATUS_IDLE);
@@ -445,7 +613,7 @@ next:
 	}
 	spin_unlock_bh(&pcie_priv->tx_desc_lock);
 
-	tasklet_schedule(&pcie_priv->tx_task);
+	pcie_tx_schedule(pcie_priv);
 }
 
 int pcie_8997_tx_init(struct ieee80211_hw *hw)
@@ -493,8 +661,12 @@ void pcie_8997_tx_skbs(unsigned long data)
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 	int num = SYSADPT_TX_WMM_QUEUES;
 	struct sk_buff *tx_skb;
-	struct mwl_amsdu_frag *amsdu_frag;
+	struct mwl_amsdu_frag *amsdu_frag, *tmp;
 	struct mwl_sta *sta_info;
+	int ac;
+
+	for (ac = 0; ac < SYSADPT_TX_WMM_QUEUES; ac++)
+		pcie_tx_pull_txqs(hw, ac, pcie_tx_enqueue);
 
 	spin_lock_bh(&pcie_priv->tx_desc_lock);
 	while (num--) {
@@ -502,7 +674,7 @@ void pcie_8997_tx_skbs(unsigned long data)
 			struct ieee80211_tx_info *tx_info;
 			struct pcie_tx_ctrl *tx_ctrl;
 
-			if (!pcie_tx_available(priv))
+			if (!pcie_tx_available(priv, 1))
 				break;
 
 			tx_skb = skb_dequeue(&pcie_priv->txq[num]);
@@ -516,7 +688,8 @@ void pcie_8997_tx_skbs(unsigned long data)
 				tx_skb = pcie_tx_do_amsdu(priv, num, tx_skb, tx_info);
 
 			if (tx_skb) {
-				if (pcie_tx_available(priv))
+				if (pcie_tx_available(priv,
+						      pcie_tx_skb_bds(tx_skb)))
 					pcie_tx_skb(priv, tx_skb);
 				else
 					skb_queue_head(&pcie_priv->txq[num],
@@ -524,30 +697,15 @@ void pcie_8997_tx_skbs(unsigned long data)
 			}
 		}
 
-		spin_lock_bh(&priv->sta_lock);
-		list_for_each_entry(sta_info, &priv->sta_list, list) {
+		list_for_each_entry_safe(amsdu_frag, tmp,
+					 &pcie_priv->amsdu_pend[num], list) {
+			sta_info = amsdu_frag->sta_info;
 			spin_lock_bh(&sta_info->amsdu_lock);
-			amsdu_frag = &sta_info->amsdu_ctrl.frag[num];
-			if (amsdu_frag->num) {
-				if (pcie_tx_available(priv))
-					pcie_tx_skb(priv, amsdu_frag->skb);
-				else
-					skb_queue_head(&pcie_priv->txq[num],
-						       amsdu_frag->skb);
-				amsdu_frag->num = 0;
-			}
+			if (amsdu_frag->num)
+				pcie_tx_amsdu_flush(priv, num, amsdu_frag);
+			list_del_init(&amsdu_frag->list);
 			spin_unlock_bh(&sta_info->amsdu_lock);
 		}
-		spin_unlock_bh(&priv->sta_lock);
-
-		if (skb_queue_len(&pcie_priv->txq[num]) <
-		    pcie_priv->txq_wake_threshold) {
-			int queue;
-
-			queue = SYSADPT_TX_WMM_QUEUES - num - 1;
-			if (ieee80211_queue_stopped(hw, queue))
-				ieee80211_wake_queue(hw, queue);
-		}
 	}
 	spin_unlock_bh(&pcie_priv->tx_desc_lock);
 }
@@ -566,23 +724,23 @@ void pcie_8997_tx_done_task(unsigned long data)
        struct mwl_priv *priv = hw->priv;
 
        pcie_pfu_tx_done(priv);
-	priv->hif.ops->irq_enable(hw);
+	pcie_irq_rearm(hw);
 }
 
-void pcie_8997_tx_xmit(struct ieee80211_hw *hw,
-		       struct ieee80211_tx_control *control,
-		       struct sk_buff *skb)
+static void pcie_tx_enqueue(struct ieee80211_hw *hw,
+			    struct ieee80211_sta *sta,
+			    struct sk_buff *skb)
 {
 	struct mwl_priv *priv = hw->priv;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 	int index;
-	struct ieee80211_sta *sta;
 	struct ieee80211_tx_info *tx_info;
 	struct mwl_vif *mwl_vif;
 	struct ieee80211_hdr *wh;
 	u8 xmitcontrol;
 	u16 qos;
 	int txpriority;
+	int stream_idx;
 	u8 tid = 0;
 	struct mwl_ampdu_stream *stream = NULL;
 	bool start_ba_session = false;
@@ -593,7 +751,6 @@ void pcie_8997_tx_xmit(struct ieee80211_hw *hw,
 	int rc;
 
 	index = skb_get_queue_mapping(skb);
-	sta = control->sta;
 
 	wh = (struct ieee80211_hdr *)skb->data;
 	tx_info = IEEE80211_SKB_CB(skb);
@@ -688,58 +845,71 @@ void pcie_8997_tx_xmit(struct ieee80211_hw *hw,
 		tid = qos & 0xf;
 		pcie_tx_count_packet(sta, tid);
 
-		spin_lock_bh(&priv->stream_lock);
-		stream = mwl_fwcmd_lookup_stream(hw, sta, tid);
+		/* established streams are looked up without stream_lock */
+		stream_idx = pcie_tx_ampdu_idx(sta, tid);
+		if (stream_idx >= 0) {
+			if (WARN_ON(!(qos &
+				    IEEE80211_QOS_CTL_ACK_POLICY_BLOCKACK))) {
+				dev_kfree_skb_any(skb);
+				return;
+			}
 
-		if (stream) {
-			if (stream->state == AMPDU_STREAM_ACTIVE) {
-				if (WARN_ON(!(qos &
-					    IEEE80211_QOS_CTL_ACK_POLICY_BLOCKACK))) {
+			txpriority = (SYSADPT_TX_WMM_QUEUES + stream_idx) %
+				     TOTAL_HW_QUEUES;
+		} else {
+			spin_lock_bh(&priv->stream_lock);
+			stream = mwl_fwcmd_lookup_stream(hw, sta, tid);
+
+			if (stream) {
+				if (stream->state == AMPDU_STREAM_ACTIVE) {
+					if (WARN_ON(!(qos &
+						    IEEE80211_QOS_CTL_ACK_POLICY_BLOCKACK))) {
+						spin_unlock_bh(&priv->stream_lock);
+						dev_kfree_skb_any(skb);
+						return;
+					}
+
+					txpriority =
+						(SYSADPT_TX_WMM_QUEUES + stream->idx) %
+						TOTAL_HW_QUEUES;
+				} else if (stream->state == AMPDU_STREAM_NEW) {
+					/* We get here if the driver sends us packets
+					 * after we've initiated a stream, but before
+					 * our ampdu_action routine has been called
+					 * with IEEE80211_AMPDU_TX_START to get the SSN
+					 * for the ADDBA request.  So this packet can
+					 * go out with no risk of sequence number
+					 * mismatch.  No special handling is required.
+					 */
+				} else {
+					/* Drop packets that would go out after the
+					 * ADDBA request was sent but before the ADDBA
+					 * response is received.  If we don't do this,
+					 * the recipient would probably receive it
+					 * after the ADDBA request with SSN 0.  This
+					 * will cause the recipient's BA receive window
+					 * to shift, which would cause the subsequent
+					 * packets in the BA stream to be discarded.
+					 * mac80211 queues our packets for us in this
+					 * case, so this is really just a safety check.
+					 */
+					wiphy_warn(hw->wiphy,
+						   "can't send packet during ADDBA\n");
 					spin_unlock_bh(&priv->stream_lock);
 					dev_kfree_skb_any(skb);
 					return;
 				}
-
-				txpriority =
-					(SYSADPT_TX_WMM_QUEUES + stream->idx) %
-					TOTAL_HW_QUEUES;
-			} else if (stream->state == AMPDU_STREAM_NEW) {
-				/* We get here if the driver sends us packets
-				 * after we've initiated a stream, but before
-				 * our ampdu_action routine has been called
-				 * with IEEE80211_AMPDU_TX_START to get the SSN
-				 * for the ADDBA request.  So this packet can
-				 * go out with no risk of sequence number
-				 * mismatch.  No special handling is required.
-				 */
 			} else {
-				/* Drop packets that would go out after the
-				 * ADDBA request was sent but before the ADDBA
-				 * response is received.  If we don't do this,
-				 * the recipient would probably receive it
-				 * after the ADDBA request with SSN 0.  This
-				 * will cause the recipient's BA receive window
-				 * to shift, which would cause the subsequent
-				 * packets in the BA stream to be discarded.
-				 * mac80211 queues our packets for us in this
-				 * case, so this is really just a safety check.
-				 */
-				wiphy_warn(hw->wiphy,
-					   "can't send packet during ADDBA\n");
-				spin_unlock_bh(&priv->stream_lock);
-				dev_kfree_skb_any(skb);
-				return;
-			}
-		} else {
-			if (mwl_fwcmd_ampdu_allowed(sta, tid)) {
-				stream = mwl_fwcmd_add_stream(hw, sta, tid);
+				if (mwl_fwcmd_ampdu_allowed(sta, tid)) {
+					stream = mwl_fwcmd_add_stream(hw, sta, tid);
 
-				if (stream)
-					start_ba_session = true;
+					if (stream)
+						start_ba_session = true;
+				}
 			}
-		}
 
-		spin_unlock_bh(&priv->stream_lock);
+			spin_unlock_bh(&priv->stream_lock);
+		}
 	} else {
 		qos &= ~IEEE80211_QOS_CTL_ACK_POLICY_MASK;
 		qos |= IEEE80211_QOS_CTL_ACK_POLICY_NORMAL;
@@ -752,13 +922,8 @@ void pcie_8997_tx_xmit(struct ieee80211_hw *hw,
 	tx_ctrl->qos_ctrl = qos;
 	tx_ctrl->xmit_control = xmitcontrol;
 
-	if (skb_queue_len(&pcie_priv->txq[index]) > pcie_priv->txq_limit)
-		ieee80211_stop_queue(hw, SYSADPT_TX_WMM_QUEUES - index - 1);
-
 	skb_queue_tail(&pcie_priv->txq[index], skb);
 
-	tasklet_schedule(&pcie_priv->tx_task);
-
 	/* Initiate the ampdu session here */
 	if (start_ba_session) {
 		spin_lock_bh(&priv->stream_lock);
@@ -776,6 +941,27 @@ void pcie_8997_tx_xmit(struct ieee80211_hw *hw,
 	}
 }
 
+void pcie_8997_tx_xmit(struct ieee80211_hw *hw,
+		       struct ieee80211_tx_control *control,
+		       struct sk_buff *skb)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+
+	pcie_tx_enqueue(hw, control->sta, skb);
+
+	pcie_tx_schedule(pcie_priv);
+}
+
+void pcie_8997_tx_wake_queue(struct ieee80211_hw *hw,
+			     struct ieee80211_txq *txq)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+
+	pcie_tx_schedule(pcie_priv);
+}
+
 void pcie_8997_tx_del_pkts_via_vif(struct ieee80211_hw *hw,
 				   struct ieee80211_vif *vif)
 {
@@ -849,10 +1035,13 @@ void pcie_8997_tx_del_ampdu_pkts(struct ieee80211_hw *hw,
 void pcie_8997_tx_del_sta_amsdu_pkts(struct ieee80211_hw *hw,
 				     struct ieee80211_sta *sta)
 {
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
 	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
 	int num;
 	struct mwl_amsdu_frag *amsdu_frag;
 
+	spin_lock_bh(&pcie_priv->tx_desc_lock);
 	spin_lock_bh(&sta_info->amsdu_lock);
 	for (num = 0; num < SYSADPT_TX_WMM_QUEUES; num++) {
 		amsdu_frag = &sta_info->amsdu_ctrl.frag[num];
@@ -861,6 +1050,8 @@ void pcie_8997_tx_del_sta_amsdu_pkts(struct ieee80211_hw *hw,
 			if (amsdu_frag->skb)
 				dev_kfree_skb_any(amsdu_frag->skb);
 		}
+		list_del_init(&amsdu_frag->list);
 	}
 	spin_unlock_bh(&sta_info->amsdu_lock);
+	spin_unlock_bh(&pcie_priv->tx_desc_lock);
 }
\ No newline at end of file
@@ -23,8 +23,18 @@
 #include <linux/pci.h>
 #include <linux/firmware.h>
 #include <linux/delay.h>
+#include <linux/completion.h>
 #include <linux/bitops.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/dim.h>
+#include <linux/kfifo.h>
 #include <net/mac80211.h>
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,6,0)
+#include <net/page_pool.h>
+#else
+#include <net/page_pool/helpers.h>
+#endif
 
 #define PCIE_DRV_NAME    KBUILD_MODNAME
 #define PCIE_DRV_VERSION "10.4.11.0"
@@ -36,8 +46,26 @@
 #define PCIE_MAX_NUM_TX_DESC      256
 #define PCIE_TX_QUEUE_LIMIT       (3 * PCIE_MAX_NUM_TX_DESC)
 #define PCIE_TX_WAKE_Q_THRESHOLD  (2 * PCIE_MAX_NUM_TX_DESC)
+#define PCIE_TXQ_QUANTUM          (4 * 1536)
+#define PCIE_TX_AMSDU_ZC_MAX_SEGS 8
 #define PCIE_MAX_NUM_RX_DESC      256
 #define PCIE_RECEIVE_LIMIT        256
+#define PCIE_IRQ_MOD_MAX_USEC     1000
+#define PCIE_ACNT_BF_FIFO_RECS    16
+
+/* Airtime queue limits for 88W8964, in usec. A station may keep
+ * PCIE_AQL_LIMIT_HIGH of airtime queued to firmware, or only
+ * PCIE_AQL_LIMIT_LOW once all stations together exceed PCIE_AQL_THRESHOLD.
+ */
+#define PCIE_AQL_LIMIT_LOW        5000
+#define PCIE_AQL_LIMIT_HIGH       12000
+#define PCIE_AQL_THRESHOLD        24000
+#define PCIE_AQL_PKT_AIRTIME      300
+#define PCIE_AQL_STALE_TIME       (HZ / 2)
+
+/* work requested from the per-radio TX thread */
+#define PCIE_TX_EVENT_TX          0
+#define PCIE_TX_EVENT_TX_DONE     1
 
 enum {
 	IEEE_TYPE_MANAGEMENT = 0,
@@ -253,6 +281,7 @@ struct pcie_dma_data {
 
 #define ISR_SRC_BITS_NDP     ((MACREG_A2HRIC_ACNT_HEAD_RDY) | \
 			      (MACREG_A2HRIC_RX_DONE_HEAD_RDY) | \
+			      (MACREG_A2HRIC_BIT_OPC_DONE)  | \
 			      (MACREG_A2HRIC_NEWDP_DFS)     | \
 			      (MACREG_A2HRIC_NEWDP_CHANNEL_SWITCH))
 
@@ -271,6 +300,7 @@ struct pcie_dma_data {
 #define MAX_AGGR_SIZE          1900
 #define TX_QUEUE_LIMIT         MAX_NUM_TX_DESC
 #define TX_WAKE_Q_THRESHOLD    (MAX_NUM_TX_DESC - 256)
+#define TX_BURST_NDP           32
 
 /* RateCode usage notes:
  * * General
@@ -483,8 +513,13 @@ struct pcie_desc_data_ndp {
 	/* keept the skb owned by fw */
 	dma_addr_t pphys_tx_buflist[MAX_TX_RING_SEND_SIZE];
 	struct sk_buff *tx_vbuflist[MAX_TX_RING_SEND_SIZE];
-	u32 tx_vbuflist_idx;              /* idx to empty slot in tx_vbuflist*/
+	/* stack of free slots in tx_vbuflist */
+	u16 tx_vbuf_free[MAX_TX_RING_SEND_SIZE];
+	u32 tx_vbuf_free_cnt;
+	u32 tx_vbuf_hwm;                  /* most slots ever in use          */
 	struct sk_buff *rx_vbuflist[MAX_NUM_RX_DESC];
+	/* set while the buffer in rx_vbuflist is posted to fw */
+	DECLARE_BITMAP(rx_posted, MAX_NUM_RX_DESC);
 	struct tx_ring_done *ptx_ring_done;
 	dma_addr_t pphys_tx_ring_done; /* ptr to first TX done desc (phys.)  */
 	struct rx_ring_done *prx_ring_done;
@@ -570,6 +605,29 @@ struct pcie_pfu_dma_data {
 	struct pcie_dma_data dma_data;
 } __packed;
 
+enum {
+	PCIE_IRQ_MOD_OFF,
+	PCIE_IRQ_MOD_STATIC,
+	PCIE_IRQ_MOD_ADAPTIVE,
+};
+
+/* Delay between finishing RX/TX done processing and unmasking the data
+ * interrupts again. In adaptive mode the delay follows the DIM profile
+ * chosen from the packets seen per NAPI poll; profile 0 re-enables at
+ * once so a single flow keeps its latency.
+ */
+struct pcie_irq_mod {
+	int mode;
+	u32 static_usec;
+	u32 usec;
+	struct dim dim;
+	struct hrtimer timer;
+	u16 polls;
+	u64 pkts;
+	u32 rearm;
+	u32 deferred;
+};
+
 struct pcie_priv {
 	struct mwl_priv *mwl_priv;
 	struct pci_dev *pdev;
@@ -578,21 +636,37 @@ struct pcie_priv {
 	u32 next_bar_num;
 
 	struct sk_buff_head txq[PCIE_NUM_OF_DESC_DATA];
+	/* stations holding a partial A-MSDU, protected by tx_desc_lock */
+	struct list_head amsdu_pend[SYSADPT_TX_WMM_QUEUES];
 
 	spinlock_t int_mask_lock ____cacheline_aligned_in_smp;
 	struct tasklet_struct tx_task;
 	struct tasklet_struct tx_done_task;
+	/* runs tx_task/tx_done_task when the data path is threaded */
+	struct task_struct *tx_thread;
+	struct mutex tx_thread_mutex;
+	unsigned long tx_thread_events;
+	bool tx_thread_off;
+	/* host command completion, signalled by OPC_DONE */
+	struct completion cmd_done;
+	bool cmd_irq;
+	struct pcie_irq_mod irq_mod;
 	/* NAPI */
 	struct net_device napi_dev;
 	struct napi_struct napi;
-	struct tasklet_struct rx_task;
 	unsigned int tx_head_room;
 	int txq_limit;
 	int txq_wake_threshold;
 	bool is_tx_schedule;
 	bool is_tx_done_schedule;
 	int recv_limit;
-	bool is_rx_schedule;
+	/* RX buffers, kept DMA mapped by the pool */
+	struct page_pool *rx_pool;
+	unsigned int rx_headroom;
+	unsigned int rx_truesize;
+	u32 rx_pool_alloc;
+	u32 rx_pool_alloc_fail;
+	u32 rx_pool_repost;
 
 	/* various descriptor data */
 	/* for tx descriptor data  */
@@ -604,6 +678,15 @@ struct pcie_priv {
 	/* new data path */
 	struct pcie_desc_data_ndp desc_data_ndp;
 	int tx_done_cnt;
+	unsigned int tx_burst;
+	u32 tx_kick_cnt;
+	u32 tx_burst_pkts;
+	/* airtime queue limits, reconciled from accounting records */
+	bool aql;
+	bool aql_kick;
+	spinlock_t aql_lock;
+	u32 aql_pending;
+	u32 aql_throttled;
 	struct ieee80211_sta *sta_link[SYSADPT_MAX_STA_SC4 + 1];
 	struct sk_buff_head rx_skb_trace;
 	struct ndp_rx_counter rx_cnts;
@@ -613,6 +696,13 @@ struct pcie_priv {
 	u32 acnt_busy;
 	u32 acnt_wrap;
 	u32 acnt_drop;
+	/* accounting ring, drained by its own NAPI poll */
+	struct napi_struct acnt_napi;
+	u32 acnt_polls;
+	u32 acnt_budget_hits;
+	/* BF MIMO records, written to a file from the account work */
+	struct kfifo acnt_bf_fifo;
+	u32 acnt_bf_drop;
 
 	/* KF2 - 88W8997 */
 	struct firmware *cal_data;
@@ -899,6 +989,116 @@ static inline void pcie_tx_count_packet(struct ieee80211_sta *sta, u8 tid)
 	}
 }
 
+/* Queue index of the station's active tx stream for tid, or -1. The
+ * value is published under stream_lock and read here in one load.
+ */
+static inline int pcie_tx_ampdu_idx(struct ieee80211_sta *sta, u8 tid)
+{
+	if (tid >= MWL_MAX_TID)
+		return -1;
+
+	return (int)READ_ONCE(mwl_dev_get_sta(sta)->ampdu_txq[tid]) - 1;
+}
+
+static inline bool pcie_aql_sta_full(struct pcie_priv *pcie_priv,
+				     struct mwl_sta *sta_info)
+{
+	u32 limit;
+	bool full;
+
+	spin_lock_bh(&pcie_priv->aql_lock);
+	limit = (pcie_priv->aql_pending > PCIE_AQL_THRESHOLD) ?
+		PCIE_AQL_LIMIT_LOW : PCIE_AQL_LIMIT_HIGH;
+	full = sta_info->aql_pending >= limit;
+	if (full) {
+		pcie_priv->aql_throttled++;
+		pcie_priv->aql_kick = true;
+	}
+	spin_unlock_bh(&pcie_priv->aql_lock);
+
+	return full;
+}
+
+/* Charge one frame at the airtime firmware last reported per packet for
+ * this station; the estimate is settled by the TX accounting records.
+ */
+static inline void pcie_aql_charge(struct pcie_priv *pcie_priv,
+				   struct mwl_sta *sta_info)
+{
+	u32 airtime;
+
+	spin_lock_bh(&pcie_priv->aql_lock);
+	airtime = sta_info->aql_pkt_airtime ? : PCIE_AQL_PKT_AIRTIME;
+	if (!sta_info->aql_pending_pkts)
+		sta_info->aql_jiffies = jiffies;
+	sta_info->aql_pending += airtime;
+	sta_info->aql_pending_pkts++;
+	pcie_priv->aql_pending += airtime;
+	spin_unlock_bh(&pcie_priv->aql_lock);
+}
+
+/* Refill the driver queue of one AC from the mac80211 per-station/TID
+ * queues, deficit round robin over the txqs mac80211 schedules: a txq gets
+ * PCIE_TXQ_QUANTUM bytes of credit once it has used up the last, keeps
+ * what it overdrew or did not get to send, and starts over when it runs
+ * dry. Returns true if mac80211 may still hold frames for this AC, either
+ * because txq_limit was reached or because the queue was too full to
+ * refill at all.
+ */
+static inline bool pcie_tx_pull_txqs(struct ieee80211_hw *hw, int ac,
+				     void (*enqueue)(struct ieee80211_hw *hw,
+						     struct ieee80211_sta *sta,
+						     struct sk_buff *skb))
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct sk_buff_head *txq_head;
+	struct ieee80211_txq *txq;
+	struct mwl_txq *mwl_txq;
+	struct mwl_sta *sta_info;
+	struct sk_buff *skb;
+	bool full = false;
+
+	txq_head = &pcie_priv->txq[SYSADPT_TX_WMM_QUEUES - ac - 1];
+	if (skb_queue_len(txq_head) >= pcie_priv->txq_wake_threshold)
+		return true;
+
+	ieee80211_txq_schedule_start(hw, ac);
+	while ((txq = ieee80211_next_txq(hw, ac))) {
+		mwl_txq = mwl_dev_get_txq(txq);
+		sta_info = NULL;
+		if (pcie_priv->aql && txq->sta &&
+		    (txq->tid < IEEE80211_NUM_TIDS))
+			sta_info = mwl_dev_get_sta(txq->sta);
+		if (mwl_txq->deficit <= 0)
+			mwl_txq->deficit += PCIE_TXQ_QUANTUM;
+		while (mwl_txq->deficit > 0) {
+			if (skb_queue_len(txq_head) >= pcie_priv->txq_limit) {
+				full = true;
+				break;
+			}
+			/* leave the rest in mac80211 where codel sees it */
+			if (sta_info && pcie_aql_sta_full(pcie_priv, sta_info))
+				break;
+			skb = ieee80211_tx_dequeue(hw, txq);
+			if (!skb) {
+				mwl_txq->deficit = 0;
+				break;
+			}
+			if (sta_info)
+				pcie_aql_charge(pcie_priv, sta_info);
+			mwl_txq->deficit -= skb->len;
+			enqueue(hw, txq->sta, skb);
+		}
+		ieee80211_return_txq(hw, txq, false);
+		if (full)
+			break;
+	}
+	ieee80211_txq_schedule_end(hw, ac);
+
+	return full;
+}
+
 static inline void pcie_rx_prepare_status(struct mwl_priv *priv, u16 format,
 					  u16 nss, u16 bw, u16 gi, u16 rate,
 					  struct ieee80211_rx_status *status)
@@ -1022,4 +1222,202 @@ static inline void pcie_mask_int(struct pcie_priv *pcie_priv,
 	spin_unlock_irqrestore(&pcie_priv->int_mask_lock, flags);
 }
 
+static inline void pcie_irq_unmask(struct ieee80211_hw *hw)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+
+	if (priv->chip_type == MWL8964)
+		pcie_mask_int(pcie_priv, MACREG_A2HRIC_RX_DONE_HEAD_RDY, true);
+	else
+		priv->hif.ops->irq_enable(hw);
+}
+
+static inline void pcie_irq_rearm(struct ieee80211_hw *hw)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct pcie_irq_mod *mod = &pcie_priv->irq_mod;
+	u32 usec = READ_ONCE(mod->usec);
+
+	mod->rearm++;
+	if (!usec) {
+		pcie_irq_unmask(hw);
+		return;
+	}
+
+	mod->deferred++;
+	hrtimer_start(&mod->timer, us_to_ktime(usec), HRTIMER_MODE_REL_SOFT);
+}
+
+/* Called from NAPI once the poll completes with work_done < budget. */
+static inline void pcie_irq_rearm_rx(struct ieee80211_hw *hw, int work_done)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct pcie_irq_mod *mod = &pcie_priv->irq_mod;
+	struct dim_sample sample;
+
+	mod->polls++;
+	mod->pkts += work_done;
+	if (mod->mode == PCIE_IRQ_MOD_ADAPTIVE) {
+		dim_update_sample(mod->polls, mod->pkts, 0, &sample);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,13,0)
+		net_dim(&mod->dim, &sample);
+#else
+		net_dim(&mod->dim, sample);
+#endif
+	}
+
+	pcie_irq_rearm(hw);
+}
+
+static inline void pcie_tx_kick(struct pcie_priv *pcie_priv, int event,
+				struct tasklet_struct *t)
+{
+	struct task_struct *thread = READ_ONCE(pcie_priv->tx_thread);
+
+	if (thread) {
+		set_bit(event, &pcie_priv->tx_thread_events);
+		wake_up_process(thread);
+	} else {
+		tasklet_schedule(t);
+	}
+}
+
+static inline void pcie_tx_schedule(struct pcie_priv *pcie_priv)
+{
+	pcie_tx_kick(pcie_priv, PCIE_TX_EVENT_TX, &pcie_priv->tx_task);
+}
+
+static inline void pcie_tx_done_schedule(struct pcie_priv *pcie_priv)
+{
+	pcie_tx_kick(pcie_priv, PCIE_TX_EVENT_TX_DONE,
+		     &pcie_priv->tx_done_task);
+}
+
+static inline void pcie_irq_mod_set(struct pcie_priv *pcie_priv,
+				    int mode, u32 usec)
+{
+	struct pcie_irq_mod *mod = &pcie_priv->irq_mod;
+
+	mod->mode = mode;
+	mod->dim.profile_ix = 0;
+	mod->dim.state = DIM_START_MEASURE;
+	if (mode == PCIE_IRQ_MOD_STATIC) {
+		mod->static_usec = min_t(u32, usec, PCIE_IRQ_MOD_MAX_USEC);
+		WRITE_ONCE(mod->usec, mod->static_usec);
+	} else {
+		WRITE_ONCE(mod->usec, 0);
+	}
+}
+
+static inline int pcie_rx_pool_create(struct mwl_priv *priv,
+				      unsigned int pool_size,
+				      unsigned int headroom,
+				      unsigned int buf_size)
+{
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct page_pool_params pp = {};
+	unsigned int truesize;
+	int rc;
+
+	truesize = SKB_DATA_ALIGN(headroom + buf_size) +
+		SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+	pp.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV;
+	pp.order = get_order(truesize);
+	pp.pool_size = pool_size;
+	pp.nid = NUMA_NO_NODE;
+	pp.dev = &(pcie_priv->pdev)->dev;
+	pp.dma_dir = DMA_FROM_DEVICE;
+	pp.offset = headroom;
+	pp.max_len = buf_size;
+
+	pcie_priv->rx_pool = page_pool_create(&pp);
+	if (IS_ERR(pcie_priv->rx_pool)) {
+		rc = PTR_ERR(pcie_priv->rx_pool);
+		pcie_priv->rx_pool = NULL;
+		wiphy_err(priv->hw->wiphy, "cannot create RX page pool\n");
+		return rc;
+	}
+
+	pcie_priv->rx_headroom = headroom;
+	pcie_priv->rx_truesize = PAGE_SIZE << pp.order;
+	pcie_priv->rx_pool_alloc = 0;
+	pcie_priv->rx_pool_alloc_fail = 0;
+	pcie_priv->rx_pool_repost = 0;
+
+	return 0;
+}
+
+static inline void pcie_rx_pool_destroy(struct pcie_priv *pcie_priv)
+{
+	if (pcie_priv->rx_pool) {
+		page_pool_destroy(pcie_priv->rx_pool);
+		pcie_priv->rx_pool = NULL;
+	}
+}
+
+/* The skb is built over a pool page when the buffer is posted, so the
+ * descriptor bookkeeping keeps dealing in skbs. Freeing the skb anywhere
+ * in the stack hands the page back to the pool with its mapping intact.
+ */
+static inline struct sk_buff *pcie_rx_pool_alloc_skb(struct pcie_priv
+						     *pcie_priv,
+						     dma_addr_t *dma)
+{
+	struct page *page;
+	struct sk_buff *skb;
+
+	page = page_pool_dev_alloc_pages(pcie_priv->rx_pool);
+	if (!page) {
+		pcie_priv->rx_pool_alloc_fail++;
+		return NULL;
+	}
+
+	skb = build_skb(page_address(page), pcie_priv->rx_truesize);
+	if (!skb) {
+		page_pool_put_full_page(pcie_priv->rx_pool, page, false);
+		pcie_priv->rx_pool_alloc_fail++;
+		return NULL;
+	}
+
+	skb_mark_for_recycle(skb);
+	skb_reserve(skb, pcie_priv->rx_headroom);
+	*dma = page_pool_get_dma_addr(page) + pcie_priv->rx_headroom;
+	pcie_priv->rx_pool_alloc++;
+
+	return skb;
+}
+
+/* Several skbs can share a pool page only through page_pool_ref_page(). */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,10,0)
+#define PCIE_RX_POOL_SHARED_PAGES 1
+#else
+#define PCIE_RX_POOL_SHARED_PAGES 0
+#endif
+
+/* Attach part of a received frame to another skb as a fragment of the
+ * pool page it arrived in. The new skb takes a pool reference, so the page
+ * goes back to the pool once every skb using it is freed, and it is
+ * charged the share of the page that span bytes of the frame occupy.
+ */
+static inline void pcie_rx_pool_add_frag(struct pcie_priv *pcie_priv,
+					 struct sk_buff *skb,
+					 struct sk_buff *newskb,
+					 u8 *data, unsigned int size,
+					 unsigned int span)
+{
+#if PCIE_RX_POOL_SHARED_PAGES
+	struct page *page = virt_to_head_page(data);
+
+	page_pool_ref_page(page);
+	skb_add_rx_frag(newskb, skb_shinfo(newskb)->nr_frags, page,
+			data - (u8 *)page_address(page), size,
+			DIV_ROUND_UP(pcie_priv->rx_truesize * span, skb->len));
+	skb_mark_for_recycle(newskb);
+#endif
+}
+
 #endif /* _DEV_H_ */
@@ -37,7 +37,11 @@
 #define PCIE_DEV_NAME "Marvell 802.11ac PCIE Adapter"
 #endif
 
-#define MAX_WAIT_FW_COMPLETE_ITERATIONS 10000
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,8,0)
+#define PCI_IRQ_INTX PCI_IRQ_LEGACY
+#endif
+
+#define MAX_WAIT_FW_COMPLETE_MS         10000
 #define CHECK_BA_TRAFFIC_TIME           HZ  /* 1 sec */
 #define CHECK_TX_DONE_TIME              50  /* msec */
 
@@ -46,6 +50,10 @@ static bool dwds_stamode = true;
 static bool optimization_level = true;
 static bool dump_hostcmd = false;
 static unsigned int feature = 0x0;
+static unsigned int tx_burst = TX_BURST_NDP;
+static bool msi = true;
+static bool threaded;
+static bool aql = true;
 
 static struct pci_device_id pcie_id_tbl[] = {
 	{ PCI_VDEVICE(MARVELL, 0x2a55),     .driver_data = MWL8864, },
@@ -176,29 +184,249 @@ static void pcie_send_cmd(struct pcie_priv *pcie_priv)
 	       pcie_priv->iobase1 + MACREG_REG_H2A_INTERRUPT_EVENTS);
 }
 
-static int pcie_wait_complete(struct mwl_priv *priv, unsigned short cmd)
+static int pcie_wait_complete(struct mwl_priv *priv, unsigned short cmd,
+			      bool *by_irq)
 {
-	unsigned int curr_iteration = MAX_WAIT_FW_COMPLETE_ITERATIONS;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	unsigned long timeout = jiffies +
+		msecs_to_jiffies(MAX_WAIT_FW_COMPLETE_MS);
 	unsigned short int_code = 0;
 
-	do {
+	*by_irq = false;
+
+	/* Once firmware has been seen to raise OPC_DONE, sleep on the
+	 * completion; otherwise fall back to polling the command buffer.
+	 * The wait is bounded to a tick so a masked interrupt only costs
+	 * latency, never the command.
+	 */
+	for (;;) {
 		int_code = le16_to_cpu(*((__le16 *)&priv->pcmd_buf[0]));
-		usleep_range(1000, 2000);
-	} while ((int_code != cmd) && (--curr_iteration) && !priv->rmmod);
+		if (int_code == cmd || priv->rmmod ||
+		    time_after(jiffies, timeout))
+			break;
+		if (pcie_priv->cmd_irq) {
+			if (wait_for_completion_timeout(&pcie_priv->cmd_done, 1))
+				*by_irq = true;
+		} else {
+			usleep_range(1000, 2000);
+		}
+	}
 
-	if (curr_iteration == 0) {
+	if (int_code != cmd && !priv->rmmod) {
 		wiphy_err(priv->hw->wiphy, "cmd 0x%04x=%s timed out\n",
 			  cmd, mwl_fwcmd_get_cmd_string(cmd));
 		wiphy_err(priv->hw->wiphy, "return code: 0x%04x\n", int_code);
 		return -EIO;
 	}
 
-	if (priv->chip_type != MWL8997)
+	if (priv->chip_type != MWL8997 && !*by_irq)
 		usleep_range(3000, 5000);
 
 	return 0;
 }
 
+static void pcie_cmd_latency(struct mwl_priv *priv, unsigned short cmd,
+			     u32 us, bool by_irq)
+{
+	struct mwl_cmd_latency *lat;
+	int i;
+
+	for (i = 0; i < MWL_CMD_LATENCY_ENTRIES; i++) {
+		lat = &priv->cmd_latency[i];
+		if (!lat->cnt)
+			lat->cmd = cmd;
+		if (lat->cmd == cmd)
+			break;
+	}
+
+	if (i == MWL_CMD_LATENCY_ENTRIES)
+		return;
+
+	lat->cnt++;
+	if (by_irq)
+		lat->irq_cnt++;
+	if (us > lat->max_us)
+		lat->max_us = us;
+	lat->total_us += us;
+}
+
+/* RX moderation delay, in usec, for each DIM profile. Profile 0 must stay
+ * at zero: adaptive mode starts there and pcie_irq_mod_set() assumes it.
+ */
+static const u16 pcie_irq_mod_profile[NET_DIM_PARAMS_NUM_PROFILES] = {
+	0, 8, 32, 64, 128
+};
+
+static enum hrtimer_restart pcie_irq_mod_timer(struct hrtimer *timer)
+{
+	struct pcie_priv *pcie_priv =
+		container_of(timer, struct pcie_priv, irq_mod.timer);
+
+	pcie_irq_unmask(pcie_priv->mwl_priv->hw);
+
+	return HRTIMER_NORESTART;
+}
+
+static void pcie_irq_mod_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct pcie_priv *pcie_priv =
+		container_of(dim, struct pcie_priv, irq_mod.dim);
+
+	if (pcie_priv->irq_mod.mode == PCIE_IRQ_MOD_ADAPTIVE)
+		WRITE_ONCE(pcie_priv->irq_mod.usec,
+			   pcie_irq_mod_profile[dim->profile_ix]);
+	dim->state = DIM_START_MEASURE;
+}
+
+static void pcie_irq_mod_init(struct pcie_priv *pcie_priv)
+{
+	struct pcie_irq_mod *mod = &pcie_priv->irq_mod;
+
+	memset(mod, 0, sizeof(*mod));
+	mod->mode = PCIE_IRQ_MOD_ADAPTIVE;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,15,0)
+	hrtimer_setup(&mod->timer, pcie_irq_mod_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL_SOFT);
+#else
+	hrtimer_init(&mod->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	mod->timer.function = pcie_irq_mod_timer;
+#endif
+	INIT_WORK(&mod->dim.work, pcie_irq_mod_dim_work);
+	mod->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+}
+
+/* The interrupts are masked by the caller; a pending rearm timer may
+ * have unmasked them in between, so mask them again once it is gone.
+ */
+static void pcie_irq_mod_stop(struct pcie_priv *pcie_priv)
+{
+	struct mwl_priv *priv = pcie_priv->mwl_priv;
+
+	cancel_work_sync(&pcie_priv->irq_mod.dim.work);
+	hrtimer_cancel(&pcie_priv->irq_mod.timer);
+	priv->hif.ops->irq_disable(priv->hw);
+}
+
+static void pcie_tx_thread_run(struct tasklet_struct *t)
+{
+	t->func(t->data);
+}
+
+static int pcie_tx_thread(void *data)
+{
+	struct ieee80211_hw *hw = (struct ieee80211_hw *)data;
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	unsigned long events;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (!READ_ONCE(pcie_priv->tx_thread_events) ||
+		    READ_ONCE(pcie_priv->tx_thread_off)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		mutex_lock(&pcie_priv->tx_thread_mutex);
+		if (!pcie_priv->tx_thread_off) {
+			events = xchg(&pcie_priv->tx_thread_events, 0);
+			/* same context the tasklets expect */
+			local_bh_disable();
+			if (test_bit(PCIE_TX_EVENT_TX_DONE, &events))
+				pcie_tx_thread_run(&pcie_priv->tx_done_task);
+			if (test_bit(PCIE_TX_EVENT_TX, &events))
+				pcie_tx_thread_run(&pcie_priv->tx_task);
+			local_bh_enable();
+		}
+		mutex_unlock(&pcie_priv->tx_thread_mutex);
+		cond_resched();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/* With the threaded module parameter, RX NAPI runs in its own kthread
+ * and TX/TX done run in a per-radio kthread instead of the tasklets, so
+ * each radio can be pinned and prioritised from user space. Both start
+ * paused, as the tasklets do.
+ */
+static void pcie_threads_init(struct ieee80211_hw *hw)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct task_struct *thread;
+
+	pcie_priv->tx_thread = NULL;
+	if (!threaded)
+		return;
+
+	strscpy(pcie_priv->napi_dev.name, wiphy_name(hw->wiphy), IFNAMSIZ);
+	if (dev_set_threaded(&pcie_priv->napi_dev, true))
+		wiphy_warn(hw->wiphy, "%s: RX stays in softirq\n",
+			   PCIE_DRV_NAME);
+
+	mutex_init(&pcie_priv->tx_thread_mutex);
+	pcie_priv->tx_thread_events = 0;
+	pcie_priv->tx_thread_off = true;
+	thread = kthread_create(pcie_tx_thread, hw, "mwltx/%s",
+				wiphy_name(hw->wiphy));
+	if (IS_ERR(thread)) {
+		wiphy_warn(hw->wiphy, "%s: TX stays in softirq\n",
+			   PCIE_DRV_NAME);
+		return;
+	}
+	pcie_priv->tx_thread = thread;
+	wake_up_process(thread);
+}
+
+static void pcie_threads_deinit(struct pcie_priv *pcie_priv)
+{
+	if (pcie_priv->tx_thread) {
+		kthread_stop(pcie_priv->tx_thread);
+		pcie_priv->tx_thread = NULL;
+	}
+}
+
+static void pcie_tx_thread_enable(struct pcie_priv *pcie_priv)
+{
+	if (!pcie_priv->tx_thread)
+		return;
+
+	WRITE_ONCE(pcie_priv->tx_thread_off, false);
+	wake_up_process(pcie_priv->tx_thread);
+}
+
+static void pcie_tx_thread_disable(struct pcie_priv *pcie_priv)
+{
+	if (!pcie_priv->tx_thread)
+		return;
+
+	WRITE_ONCE(pcie_priv->tx_thread_off, true);
+	/* wait for a pass that is already running */
+	mutex_lock(&pcie_priv->tx_thread_mutex);
+	mutex_unlock(&pcie_priv->tx_thread_mutex);
+}
+
+static int pcie_get_threads_info(struct pcie_priv *pcie_priv, char *buf,
+				 size_t size)
+{
+	struct task_struct *rx_thread = pcie_priv->napi.thread;
+	char *p = buf;
+	int len = 0;
+
+	len += scnprintf(p + len, size - len, "rx thread pid: %d\n",
+			 rx_thread ? task_pid_nr(rx_thread) : 0);
+	len += scnprintf(p + len, size - len, "tx thread pid: %d\n",
+			 pcie_priv->tx_thread ?
+			 task_pid_nr(pcie_priv->tx_thread) : 0);
+	return len;
+}
+
 static int pcie_init_8997(struct ieee80211_hw *hw)
 {
 	struct mwl_priv *priv = hw->priv;
@@ -208,6 +436,7 @@ static int pcie_init_8997(struct ieee80211_hw *hw)
 	int rc, i;
 
 	spin_lock_init(&pcie_priv->int_mask_lock);
+	pcie_irq_mod_init(pcie_priv);
 	tasklet_init(&pcie_priv->tx_task,
 		     (void *)pcie_8997_tx_skbs, (unsigned long)hw);
 	tasklet_disable(&pcie_priv->tx_task);
@@ -218,6 +447,7 @@ static int pcie_init_8997(struct ieee80211_hw *hw)
 	init_dummy_netdev(&pcie_priv->napi_dev);
 	netif_napi_add(&pcie_priv->napi_dev, &pcie_priv->napi,
 		       pcie_8997_poll_napi);
+	pcie_threads_init(hw);
 	pcie_priv->txq_limit = PCIE_TX_QUEUE_LIMIT;
 	pcie_priv->txq_wake_threshold = PCIE_TX_WAKE_Q_THRESHOLD;
 	pcie_priv->recv_limit = PCIE_RECEIVE_LIMIT;
@@ -291,6 +521,8 @@ err_mwl_rx_init:
 
 err_mwl_tx_init:
 
+	netif_napi_del(&pcie_priv->napi);
+	pcie_threads_deinit(pcie_priv);
 	wiphy_err(hw->wiphy, "%s: init fail\n", PCIE_DRV_NAME);
 
 	return rc;
@@ -305,6 +537,7 @@ static int pcie_init_8864(struct ieee80211_hw *hw)
 	int rc, i;
 
 	spin_lock_init(&pcie_priv->int_mask_lock);
+	pcie_irq_mod_init(pcie_priv);
 	tasklet_init(&pcie_priv->tx_task, (void *)pcie_8864_tx_skbs, (unsigned long)hw);
 	tasklet_disable(&pcie_priv->tx_task);
 	tasklet_init(&pcie_priv->tx_done_task, (void *)pcie_8864_tx_done_task, (unsigned long)hw);
@@ -312,6 +545,7 @@ static int pcie_init_8864(struct ieee80211_hw *hw)
 	spin_lock_init(&pcie_priv->tx_desc_lock);
 	init_dummy_netdev(&pcie_priv->napi_dev);
 	netif_napi_add(&pcie_priv->napi_dev, &pcie_priv->napi, pcie_8864_poll_napi);
+	pcie_threads_init(hw);
 	pcie_priv->txq_limit = PCIE_TX_QUEUE_LIMIT;
 	pcie_priv->txq_wake_threshold = PCIE_TX_WAKE_Q_THRESHOLD;
 	pcie_priv->recv_limit = PCIE_RECEIVE_LIMIT;
@@ -386,6 +620,8 @@ err_mwl_rx_init:
 
 err_mwl_tx_init:
 
+	netif_napi_del(&pcie_priv->napi);
+	pcie_threads_deinit(pcie_priv);
 	wiphy_err(hw->wiphy, "%s: init fail\n", PCIE_DRV_NAME);
 
 	return rc;
@@ -399,6 +635,9 @@ static void pcie_deinit_8997(struct ieee80211_hw *hw)
 	pcie_8997_rx_deinit(hw);
 	pcie_8997_tx_deinit(hw);
 	tasklet_kill(&pcie_priv->tx_done_task);
+	pcie_irq_mod_stop(pcie_priv);
+	netif_napi_del(&pcie_priv->napi);
+	pcie_threads_deinit(pcie_priv);
 	tasklet_kill(&pcie_priv->tx_task);
 	pcie_reset(hw);
 }
@@ -411,6 +650,9 @@ static void pcie_deinit_8864(struct ieee80211_hw *hw)
 	pcie_8864_rx_deinit(hw);
 	pcie_8864_tx_deinit(hw);
 	tasklet_kill(&pcie_priv->tx_done_task);
+	pcie_irq_mod_stop(pcie_priv);
+	netif_napi_del(&pcie_priv->napi);
+	pcie_threads_deinit(pcie_priv);
 	tasklet_kill(&pcie_priv->tx_task);
 	pcie_reset(hw);
 }
@@ -430,9 +672,58 @@ static int pcie_get_info(struct ieee80211_hw *hw, char *buf, size_t size)
 			 "tx limit: %d\n", pcie_priv->txq_limit);
 	len += scnprintf(p + len, size - len,
 			 "rx limit: %d\n", pcie_priv->recv_limit);
+	len += pcie_get_threads_info(pcie_priv, p + len, size - len);
+	return len;
+}
+
+static int pcie_get_rx_pool_status(struct pcie_priv *pcie_priv, char *buf,
+				   size_t size)
+{
+#ifdef CONFIG_PAGE_POOL_STATS
+	struct page_pool_stats stats = {};
+#endif
+	char *p = buf;
+	int len = 0;
+
+	len += scnprintf(p + len, size - len, "rx_pool_alloc: %u\n",
+			 pcie_priv->rx_pool_alloc);
+	len += scnprintf(p + len, size - len, "rx_pool_alloc_fail: %u\n",
+			 pcie_priv->rx_pool_alloc_fail);
+	len += scnprintf(p + len, size - len, "rx_pool_repost: %u\n",
+			 pcie_priv->rx_pool_repost);
+#ifdef CONFIG_PAGE_POOL_STATS
+	if (pcie_priv->rx_pool &&
+	    page_pool_get_stats(pcie_priv->rx_pool, &stats)) {
+		u64 fast = stats.alloc_stats.fast;
+		u64 slow = stats.alloc_stats.slow +
+			stats.alloc_stats.slow_high_order;
+
+		len += scnprintf(p + len, size - len,
+				 "rx_pool_fast: %llu\n", fast);
+		len += scnprintf(p + len, size - len,
+				 "rx_pool_slow: %llu\n", slow);
+		len += scnprintf(p + len, size - len,
+				 "rx_pool_recycle_pct: %llu\n",
+				 (fast + slow) ?
+				 div64_u64(fast * 100, fast + slow) : 0);
+		len += scnprintf(p + len, size - len,
+				 "rx_pool_ring_full: %llu\n",
+				 stats.recycle_stats.ring_full);
+		len += scnprintf(p + len, size - len,
+				 "rx_pool_released: %llu\n",
+				 stats.recycle_stats.released_refcnt);
+	}
+#endif
 	return len;
 }
 
+static int pcie_get_rx_status(struct ieee80211_hw *hw, char *buf, size_t size)
+{
+	struct mwl_priv *priv = hw->priv;
+
+	return pcie_get_rx_pool_status(priv->hif.priv, buf, size);
+}
+
 static void pcie_enable_data_tasks(struct ieee80211_hw *hw)
 {
 	struct mwl_priv *priv = hw->priv;
@@ -440,6 +731,7 @@ static void pcie_enable_data_tasks(struct ieee80211_hw *hw)
 
 	tasklet_enable(&pcie_priv->tx_task);
 	tasklet_enable(&pcie_priv->tx_done_task);
+	pcie_tx_thread_enable(pcie_priv);
 	napi_enable(&pcie_priv->napi);
 }
 
@@ -448,10 +740,12 @@ static void pcie_disable_data_tasks(struct ieee80211_hw *hw)
 	struct mwl_priv *priv = hw->priv;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 
+	pcie_tx_thread_disable(pcie_priv);
 	tasklet_disable(&pcie_priv->tx_task);
 	tasklet_disable(&pcie_priv->tx_done_task);
 	napi_synchronize(&pcie_priv->napi);
 	napi_disable(&pcie_priv->napi);
+	pcie_irq_mod_stop(pcie_priv);
 }
 
 static int pcie_exec_cmd(struct ieee80211_hw *hw, unsigned short cmd)
@@ -459,6 +753,8 @@ static int pcie_exec_cmd(struct ieee80211_hw *hw, unsigned short cmd)
 	struct mwl_priv *priv = hw->priv;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 	bool busy = false;
+	bool by_irq;
+	ktime_t start;
 
 	might_sleep();
 
@@ -473,8 +769,10 @@ static int pcie_exec_cmd(struct ieee80211_hw *hw, unsigned short cmd)
 		if (priv->dump_hostcmd)
 			wiphy_debug(priv->hw->wiphy, "send cmd 0x%04x=%s\n",
 				    cmd, mwl_fwcmd_get_cmd_string(cmd));
+		reinit_completion(&pcie_priv->cmd_done);
+		start = ktime_get();
 		pcie_send_cmd(pcie_priv);
-		if (pcie_wait_complete(priv, 0x8000 | cmd)) {
+		if (pcie_wait_complete(priv, 0x8000 | cmd, &by_irq)) {
 			wiphy_err(priv->hw->wiphy, "timeout: 0x%04x\n", cmd);
 			priv->in_send_cmd = false;
 			priv->cmd_timeout = true;
@@ -484,6 +782,8 @@ static int pcie_exec_cmd(struct ieee80211_hw *hw, unsigned short cmd)
 					MWL_VENDOR_EVENT_CMD_TIMEOUT);
 			return -EIO;
 		}
+		pcie_cmd_latency(priv, cmd,
+				 ktime_us_delta(ktime_get(), start), by_irq);
 	} else {
 		wiphy_warn(priv->hw->wiphy,
 			   "previous command is running or module removed\n");
@@ -501,7 +801,7 @@ static int pcie_get_irq_num(struct ieee80211_hw *hw)
 	struct mwl_priv *priv = hw->priv;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 
-	return pcie_priv->pdev->irq;
+	return pci_irq_vector(pcie_priv->pdev, 0);
 }
 
 static irqreturn_t pcie_isr_8864(struct ieee80211_hw *hw)
@@ -521,9 +821,14 @@ static irqreturn_t pcie_isr_8864(struct ieee80211_hw *hw)
 		writel(~int_status,
 		       pcie_priv->iobase1 + MACREG_REG_A2H_INTERRUPT_CAUSE);
 
+		if (int_status & MACREG_A2HRIC_BIT_OPC_DONE) {
+			pcie_priv->cmd_irq = true;
+			complete(&pcie_priv->cmd_done);
+		}
+
 		if (int_status & MACREG_A2HRIC_BIT_TX_DONE) {
 			priv->hif.ops->irq_disable(hw);
-			tasklet_schedule(&pcie_priv->tx_done_task);
+			pcie_tx_done_schedule(pcie_priv);
 		}
 
 		if (int_status & MACREG_A2HRIC_BIT_RX_RDY) {
@@ -563,9 +868,14 @@ static irqreturn_t pcie_isr_8997(struct ieee80211_hw *hw)
 		writel(~int_status,
 		       pcie_priv->iobase1 + MACREG_REG_A2H_INTERRUPT_CAUSE);
 
+		if (int_status & MACREG_A2HRIC_BIT_OPC_DONE) {
+			pcie_priv->cmd_irq = true;
+			complete(&pcie_priv->cmd_done);
+		}
+
 		if (int_status & MACREG_A2HRIC_BIT_TX_DONE) {
 			priv->hif.ops->irq_disable(hw);
-			tasklet_schedule(&pcie_priv->tx_done_task);
+			pcie_tx_done_schedule(pcie_priv);
 		}
 
 		if (int_status & MACREG_A2HRIC_BIT_RX_RDY) {
@@ -758,6 +1068,7 @@ static struct mwl_hif_ops pcie_hif_ops_8997 = {
 	.init                  = pcie_init_8997,
 	.deinit                = pcie_deinit_8997,
 	.get_info              = pcie_get_info,
+	.get_rx_status         = pcie_get_rx_status,
 	.enable_data_tasks     = pcie_enable_data_tasks,
 	.disable_data_tasks    = pcie_disable_data_tasks,
 	.exec_cmd              = pcie_exec_cmd,
@@ -768,6 +1079,7 @@ static struct mwl_hif_ops pcie_hif_ops_8997 = {
 	.download_firmware     = pcie_download_firmware,
 	.timer_routine         = pcie_timer_routine,
 	.tx_xmit               = pcie_8997_tx_xmit,
+	.tx_wake_queue         = pcie_8997_tx_wake_queue,
 	.tx_del_pkts_via_vif   = pcie_8997_tx_del_pkts_via_vif,
 	.tx_del_pkts_via_sta   = pcie_8997_tx_del_pkts_via_sta,
 	.tx_del_ampdu_pkts     = pcie_8997_tx_del_ampdu_pkts,
@@ -787,6 +1099,7 @@ static struct mwl_hif_ops pcie_hif_ops_8864 = {
 	.init                  = pcie_init_8864,
 	.deinit                = pcie_deinit_8864,
 	.get_info              = pcie_get_info,
+	.get_rx_status         = pcie_get_rx_status,
 	.enable_data_tasks     = pcie_enable_data_tasks,
 	.disable_data_tasks    = pcie_disable_data_tasks,
 	.exec_cmd              = pcie_exec_cmd,
@@ -797,6 +1110,7 @@ static struct mwl_hif_ops pcie_hif_ops_8864 = {
 	.download_firmware     = pcie_download_firmware,
 	.timer_routine         = pcie_timer_routine,
 	.tx_xmit               = pcie_8864_tx_xmit,
+	.tx_wake_queue         = pcie_8864_tx_wake_queue,
 	.tx_del_pkts_via_vif   = pcie_8864_tx_del_pkts_via_vif,
 	.tx_del_pkts_via_sta   = pcie_8864_tx_del_pkts_via_sta,
 	.tx_del_ampdu_pkts     = pcie_8864_tx_del_ampdu_pkts,
@@ -807,6 +1121,8 @@ static struct mwl_hif_ops pcie_hif_ops_8864 = {
 	.reg_access            = pcie_reg_access,
 };
 
+static int pcie_account_poll_napi_ndp(struct napi_struct *napi, int budget);
+
 static int pcie_init_ndp(struct ieee80211_hw *hw)
 {
 	struct mwl_priv *priv = hw->priv;
@@ -816,18 +1132,34 @@ static int pcie_init_ndp(struct ieee80211_hw *hw)
 	int rc;
 
 	spin_lock_init(&pcie_priv->int_mask_lock);
+	pcie_irq_mod_init(pcie_priv);
 	tasklet_init(&pcie_priv->tx_task,
 		     (void *)pcie_tx_skbs_ndp, (unsigned long)hw);
 	tasklet_disable(&pcie_priv->tx_task);
 	spin_lock_init(&pcie_priv->tx_desc_lock);
-	tasklet_init(&pcie_priv->rx_task,
-		     (void *)pcie_rx_recv_ndp, (unsigned long)hw);
-	tasklet_disable(&pcie_priv->rx_task);
+	init_dummy_netdev(&pcie_priv->napi_dev);
+	netif_napi_add(&pcie_priv->napi_dev, &pcie_priv->napi,
+		       pcie_rx_poll_napi_ndp);
+	netif_napi_add(&pcie_priv->napi_dev, &pcie_priv->acnt_napi,
+		       pcie_account_poll_napi_ndp);
+	pcie_threads_init(hw);
 	pcie_priv->txq_limit = TX_QUEUE_LIMIT;
 	pcie_priv->txq_wake_threshold = TX_WAKE_Q_THRESHOLD;
 	pcie_priv->is_tx_schedule = false;
-	pcie_priv->recv_limit = MAX_NUM_RX_DESC;
-	pcie_priv->is_rx_schedule = false;
+	pcie_priv->tx_burst = clamp_t(unsigned int, tx_burst,
+				      1, MAX_NUM_TX_DESC - 1);
+	pcie_priv->recv_limit = NAPI_POLL_WEIGHT;
+	spin_lock_init(&pcie_priv->aql_lock);
+	pcie_priv->aql = aql;
+	pcie_priv->aql_pending = 0;
+
+	rc = kfifo_alloc(&pcie_priv->acnt_bf_fifo, PCIE_ACNT_BF_FIFO_RECS *
+			 sizeof(struct acnt_bf_mimo_ctrl_s), GFP_KERNEL);
+	if (rc) {
+		wiphy_err(hw->wiphy, "%s: fail to allocate accounting fifo\n",
+			  PCIE_DRV_NAME);
+		goto err_acnt_fifo;
+	}
 
 	rc = pcie_tx_init_ndp(hw);
 	if (rc) {
@@ -892,6 +1224,13 @@ err_mwl_rx_init:
 
 err_mwl_tx_init:
 
+	kfifo_free(&pcie_priv->acnt_bf_fifo);
+
+err_acnt_fifo:
+
+	netif_napi_del(&pcie_priv->acnt_napi);
+	netif_napi_del(&pcie_priv->napi);
+	pcie_threads_deinit(pcie_priv);
 	wiphy_err(hw->wiphy, "%s: init fail\n", PCIE_DRV_NAME);
 
 	return rc;
@@ -904,8 +1243,12 @@ static void pcie_deinit_ndp(struct ieee80211_hw *hw)
 
 	pcie_rx_deinit_ndp(hw);
 	pcie_tx_deinit_ndp(hw);
-	tasklet_kill(&pcie_priv->rx_task);
+	pcie_irq_mod_stop(pcie_priv);
+	netif_napi_del(&pcie_priv->acnt_napi);
+	netif_napi_del(&pcie_priv->napi);
+	pcie_threads_deinit(pcie_priv);
 	tasklet_kill(&pcie_priv->tx_task);
+	kfifo_free(&pcie_priv->acnt_bf_fifo);
 	pcie_reset(hw);
 }
 
@@ -922,8 +1265,21 @@ static int pcie_get_info_ndp(struct ieee80211_hw *hw, char *buf, size_t size)
 			 pcie_priv->iobase1);
 	len += scnprintf(p + len, size - len,
 			 "tx limit: %d\n", pcie_priv->txq_limit);
+	len += scnprintf(p + len, size - len,
+			 "tx burst: %d\n", pcie_priv->tx_burst);
 	len += scnprintf(p + len, size - len,
 			 "rx limit: %d\n", pcie_priv->recv_limit);
+	len += scnprintf(p + len, size - len, "aql: %s\n",
+			 pcie_priv->aql ? "enable" : "disable");
+	len += scnprintf(p + len, size - len, "aql pending (us): %u\n",
+			 pcie_priv->aql_pending);
+	len += scnprintf(p + len, size - len, "aql throttled: %u\n",
+			 pcie_priv->aql_throttled);
+	len += scnprintf(p + len, size - len,
+			 "account polls: %u budget hits: %u bf drops: %u\n",
+			 pcie_priv->acnt_polls, pcie_priv->acnt_budget_hits,
+			 pcie_priv->acnt_bf_drop);
+	len += pcie_get_threads_info(pcie_priv, p + len, size - len);
 	return len;
 }
 
@@ -947,8 +1303,17 @@ static int pcie_get_tx_status_ndp(struct ieee80211_hw *hw, char *buf,
 			 readl(pcie_priv->iobase1 + MACREG_REG_TXDONEHEAD));
 	len += scnprintf(p + len, size - len, "tx_done_tail: %d\n",
 			 pcie_priv->desc_data_ndp.tx_done_tail);
-	len += scnprintf(p + len, size - len, "tx_vbuflist_idx: %d\n",
-			 pcie_priv->desc_data_ndp.tx_vbuflist_idx);
+	len += scnprintf(p + len, size - len, "tx_vbuf_free_cnt: %d\n",
+			 pcie_priv->desc_data_ndp.tx_vbuf_free_cnt);
+	len += scnprintf(p + len, size - len, "tx_vbuf_hwm: %d\n",
+			 pcie_priv->desc_data_ndp.tx_vbuf_hwm);
+	len += scnprintf(p + len, size - len, "tx_kick_cnt: %u\n",
+			 pcie_priv->tx_kick_cnt);
+	len += scnprintf(p + len, size - len, "tx_burst_pkts: %u\n",
+			 pcie_priv->tx_burst_pkts);
+	len += scnprintf(p + len, size - len, "tx_burst_avg: %u\n",
+			 pcie_priv->tx_kick_cnt ?
+			 pcie_priv->tx_burst_pkts / pcie_priv->tx_kick_cnt : 0);
 	return len;
 }
 
@@ -966,6 +1331,9 @@ static int pcie_get_rx_status_ndp(struct ieee80211_hw *hw, char *buf,
 			 readl(pcie_priv->iobase1 + MACREG_REG_RXDONETAIL));
 	len += scnprintf(p + len, size - len, "rx_desc_head: %d\n",
 			 readl(pcie_priv->iobase1 + MACREG_REG_RXDESCHEAD));
+	len += scnprintf(p + len, size - len, "rx_posted: %d\n",
+			 bitmap_weight(pcie_priv->desc_data_ndp.rx_posted,
+				       MAX_NUM_RX_DESC));
 	len += scnprintf(p + len, size - len, "rx_skb_trace: %d\n",
 			 skb_queue_len(&pcie_priv->rx_skb_trace));
 	len += scnprintf(p + len, size - len, "rx_skb_unlink_err: %d\n",
@@ -974,6 +1342,7 @@ static int pcie_get_rx_status_ndp(struct ieee80211_hw *hw, char *buf,
 			 pcie_priv->signature_err);
 	len += scnprintf(p + len, size - len, "recheck_rxringdone: %d\n",
 			 pcie_priv->recheck_rxringdone);
+	len += pcie_get_rx_pool_status(pcie_priv, p + len, size - len);
 	len += scnprintf(p + len, size - len, "fast_data_cnt: %d\n",
 			 pcie_priv->rx_cnts.fast_data_cnt);
 	len += scnprintf(p + len, size - len, "fast_bad_amsdu_cnt: %d\n",
@@ -1009,7 +1378,9 @@ static void pcie_enable_data_tasks_ndp(struct ieee80211_hw *hw)
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 
 	tasklet_enable(&pcie_priv->tx_task);
-	tasklet_enable(&pcie_priv->rx_task);
+	pcie_tx_thread_enable(pcie_priv);
+	napi_enable(&pcie_priv->napi);
+	napi_enable(&pcie_priv->acnt_napi);
 }
 
 static void pcie_disable_data_tasks_ndp(struct ieee80211_hw *hw)
@@ -1017,8 +1388,12 @@ static void pcie_disable_data_tasks_ndp(struct ieee80211_hw *hw)
 	struct mwl_priv *priv = hw->priv;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
 
+	pcie_tx_thread_disable(pcie_priv);
 	tasklet_disable(&pcie_priv->tx_task);
-	tasklet_disable(&pcie_priv->rx_task);
+	napi_synchronize(&pcie_priv->napi);
+	napi_disable(&pcie_priv->napi);
+	napi_disable(&pcie_priv->acnt_napi);
+	pcie_irq_mod_stop(pcie_priv);
 }
 
 static irqreturn_t pcie_isr_ndp(struct ieee80211_hw *hw)
@@ -1038,17 +1413,23 @@ static irqreturn_t pcie_isr_ndp(struct ieee80211_hw *hw)
 		writel(~int_status,
 		       pcie_priv->iobase1 + MACREG_REG_A2H_INTERRUPT_CAUSE);
 
-		if (int_status & MACREG_A2HRIC_ACNT_HEAD_RDY)
-			ieee80211_queue_work(hw, &priv->account_handle);
+		if (int_status & MACREG_A2HRIC_BIT_OPC_DONE) {
+			pcie_priv->cmd_irq = true;
+			complete(&pcie_priv->cmd_done);
+		}
+
+		if (int_status & MACREG_A2HRIC_ACNT_HEAD_RDY) {
+			pcie_mask_int(pcie_priv,
+				      MACREG_A2HRIC_ACNT_HEAD_RDY,
+				      false);
+			napi_schedule(&pcie_priv->acnt_napi);
+		}
 
 		if (int_status & MACREG_A2HRIC_RX_DONE_HEAD_RDY) {
-			if (!pcie_priv->is_rx_schedule) {
-				pcie_mask_int(pcie_priv,
-					      MACREG_A2HRIC_RX_DONE_HEAD_RDY,
-					      false);
-				tasklet_schedule(&pcie_priv->rx_task);
-				pcie_priv->is_rx_schedule = true;
-			}
+			pcie_mask_int(pcie_priv,
+				      MACREG_A2HRIC_RX_DONE_HEAD_RDY,
+				      false);
+			napi_schedule(&pcie_priv->napi);
 		}
 
 		if (int_status & MACREG_A2HRIC_NEWDP_DFS) {
@@ -1076,6 +1457,90 @@ static void pcie_irq_enable_ndp(struct ieee80211_hw *hw)
 	}
 }
 
+static void pcie_aql_kick(struct pcie_priv *pcie_priv)
+{
+	bool kick;
+
+	spin_lock_bh(&pcie_priv->aql_lock);
+	kick = pcie_priv->aql_kick;
+	pcie_priv->aql_kick = false;
+	spin_unlock_bh(&pcie_priv->aql_lock);
+
+	if (kick && !pcie_priv->is_tx_schedule) {
+		pcie_tx_schedule(pcie_priv);
+		pcie_priv->is_tx_schedule = true;
+	}
+}
+
+static void pcie_aql_sta_reset(struct pcie_priv *pcie_priv,
+			       struct mwl_sta *sta_info)
+{
+	spin_lock_bh(&pcie_priv->aql_lock);
+	pcie_priv->aql_pending -= min(pcie_priv->aql_pending,
+				      sta_info->aql_pending);
+	sta_info->aql_pending = 0;
+	sta_info->aql_pending_pkts = 0;
+	spin_unlock_bh(&pcie_priv->aql_lock);
+}
+
+/* Settle npkts frames of the station against the airtime firmware used
+ * for them. Frames are charged alike, so each releases an equal share.
+ */
+static void pcie_aql_consume(struct pcie_priv *pcie_priv,
+			     struct mwl_sta *sta_info,
+			     u16 npkts, u16 air_time)
+{
+	u32 pkt_airtime, release;
+
+	if (!npkts)
+		return;
+
+	pkt_airtime = max_t(u32, air_time / npkts, 1);
+
+	spin_lock_bh(&pcie_priv->aql_lock);
+	if (sta_info->aql_pkt_airtime)
+		sta_info->aql_pkt_airtime =
+			(sta_info->aql_pkt_airtime * 7 + pkt_airtime) >> 3;
+	else
+		sta_info->aql_pkt_airtime = pkt_airtime;
+	if (sta_info->aql_pending_pkts) {
+		npkts = min_t(u32, npkts, sta_info->aql_pending_pkts);
+		release = mult_frac(sta_info->aql_pending, npkts,
+				    sta_info->aql_pending_pkts);
+		sta_info->aql_pending -= release;
+		sta_info->aql_pending_pkts -= npkts;
+		pcie_priv->aql_pending -= min(pcie_priv->aql_pending,
+					      release);
+		sta_info->aql_jiffies = jiffies;
+	}
+	spin_unlock_bh(&pcie_priv->aql_lock);
+}
+
+/* Frames dropped by firmware never show up in the accounting ring; drop
+ * whatever a station has had pending for too long.
+ */
+static void pcie_aql_expire(struct ieee80211_hw *hw, bool all)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct mwl_sta *sta_info;
+
+	if (!pcie_priv->aql)
+		return;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta_info, &priv->sta_list, list) {
+		if (!sta_info->aql_pending_pkts)
+			continue;
+		if (all || time_after(jiffies, sta_info->aql_jiffies +
+				      PCIE_AQL_STALE_TIME))
+			pcie_aql_sta_reset(pcie_priv, sta_info);
+	}
+	rcu_read_unlock();
+
+	pcie_aql_kick(pcie_priv);
+}
+
 static void pcie_timer_routine_ndp(struct ieee80211_hw *hw)
 {
 	struct mwl_priv *priv = hw->priv;
@@ -1086,7 +1551,7 @@ static void pcie_timer_routine_ndp(struct ieee80211_hw *hw)
 	if (!pcie_priv->is_tx_schedule) {
 		while (num--) {
 			if (skb_queue_len(&pcie_priv->txq[num]) > 0) {
-				tasklet_schedule(&pcie_priv->tx_task);
+				pcie_tx_schedule(pcie_priv);
 				pcie_priv->is_tx_schedule = true;
 				break;
 			}
@@ -1095,6 +1560,7 @@ static void pcie_timer_routine_ndp(struct ieee80211_hw *hw)
 
 	if ((++cnt * SYSADPT_TIMER_WAKEUP_TIME) >= CHECK_TX_DONE_TIME) {
 		pcie_tx_done_ndp(hw);
+		pcie_aql_expire(hw, false);
 		cnt = 0;
 	}
 }
@@ -1116,6 +1582,8 @@ static void pcie_set_sta_id(struct ieee80211_hw *hw,
 	sta_info = mwl_dev_get_sta(sta);
 	stnid = sta_mode ? 0 : sta_info->stnid;
 	pcie_priv->sta_link[stnid] = set ? sta : NULL;
+	if (!set)
+		pcie_aql_sta_reset(pcie_priv, sta_info);
 }
 
 static void pcie_tx_account(struct mwl_priv *priv,
@@ -1460,167 +1928,282 @@ static void pcie_bf_mimo_ctrl_decode(struct mwl_priv *priv,
 #endif
 }
 
-static void pcie_process_account(struct ieee80211_hw *hw)
+static void pcie_report_airtime(struct mwl_sta *sta_info, u8 tid,
+				u32 tx_airtime, u32 rx_airtime)
+{
+	struct ieee80211_sta *sta;
+
+	if (!tx_airtime && !rx_airtime)
+		return;
+
+	sta = container_of((void *)sta_info, struct ieee80211_sta, drv_priv);
+	ieee80211_sta_register_airtime(sta, tid, tx_airtime, rx_airtime);
+}
+
+/* TID of a received PPDU, from the QoS control of the header firmware
+ * copied into the record; 0 when it is not there.
+ */
+static u8 pcie_rx_account_tid(struct acnt_rx_s *acnt_rx)
+{
+	struct pcie_dma_data *dma_data;
+	u8 *end = (u8 *)acnt_rx + acnt_rx->len * 4;
+	u8 *qos;
+
+	dma_data = (struct pcie_dma_data *)&acnt_rx->rx_info.hdr[0];
+	if ((u8 *)&dma_data->wh.seq_ctrl + 2 > end ||
+	    !ieee80211_is_data_qos(dma_data->wh.frame_control))
+		return 0;
+
+	qos = ieee80211_get_qos_ctl(&dma_data->wh);
+	if (qos + 1 > end)
+		return 0;
+
+	return *qos & IEEE80211_QOS_CTL_TID_MASK;
+}
+
+static void pcie_account_record(struct ieee80211_hw *hw, struct acnt_s *acnt)
 {
 	struct mwl_priv *priv = hw->priv;
 	struct pcie_priv *pcie_priv = priv->hif.priv;
-	struct pcie_desc_data_ndp *desc = &pcie_priv->desc_data_ndp;
-	u32 acnt_head, acnt_tail;
-	u32 read_size;
-	u8 *acnt_recds;
-	u8 *pstart, *pend;
-	struct acnt_s *acnt;
 	struct acnt_tx_s *acnt_tx;
 	struct acnt_rx_s *acnt_rx;
 	struct acnt_ra_s *acnt_ra;
 	struct acnt_ba_s *acnt_ba;
-	struct acnt_bf_mimo_ctrl_s *acnt_bf_mimo_ctrl;
 	struct pcie_dma_data *dma_data;
+	struct ieee80211_sta *sta;
 	struct mwl_sta *sta_info;
 	u16 nf_a, nf_b, nf_c, nf_d;
 	u16 stnid;
 	u8 type;
 
-	acnt_head = readl(pcie_priv->iobase1 + MACREG_REG_ACNTHEAD);
-	acnt_tail = readl(pcie_priv->iobase1 + MACREG_REG_ACNTTAIL);
-
-	if (acnt_tail == acnt_head)
-		return;
-
-	if (acnt_tail > acnt_head) {
-		read_size = desc->acnt_ring_size - acnt_tail + acnt_head;
-		if (read_size > desc->acnt_ring_size) {
-			wiphy_err(hw->wiphy,
-				  "account size overflow (%d %d %d)\n",
-				  acnt_head, acnt_tail, read_size);
-			goto process_next;
+	switch (le16_to_cpu(acnt->code)) {
+	case ACNT_CODE_BUSY:
+		pcie_priv->acnt_busy++;
+		break;
+	case ACNT_CODE_WRAP:
+		pcie_priv->acnt_wrap++;
+		break;
+	case ACNT_CODE_DROP:
+		pcie_priv->acnt_drop++;
+		break;
+	case ACNT_CODE_TX_ENQUEUE:
+		acnt_tx = (struct acnt_tx_s *)acnt;
+		rcu_read_lock();
+		sta_info = utils_find_sta(priv, acnt_tx->hdr.wh.addr1);
+		if (sta_info) {
+			spin_lock_bh(&priv->sta_lock);
+			pcie_tx_account(priv, sta_info, acnt_tx);
+			spin_unlock_bh(&priv->sta_lock);
+			if (pcie_priv->aql)
+				pcie_aql_consume(pcie_priv, sta_info,
+					le16_to_cpu(acnt_tx->npkts),
+					le16_to_cpu(acnt_tx->air_time));
+			/* station data queues are per TID */
+			pcie_report_airtime(sta_info,
+				le16_to_cpu(acnt_tx->qid) &
+				(SYSADPT_MAX_TID - 1),
+				le16_to_cpu(acnt_tx->air_time), 0);
 		}
-		memset(desc->pacnt_buf, 0, desc->acnt_ring_size);
-		memcpy(desc->pacnt_buf, desc->pacnt_ring + acnt_tail,
-		       desc->acnt_ring_size - acnt_tail);
-		memcpy(desc->pacnt_buf + desc->acnt_ring_size - acnt_tail,
-		       desc->pacnt_ring, acnt_head);
-		acnt_recds = desc->pacnt_buf;
-	} else {
-		read_size = acnt_head - acnt_tail;
-		if (read_size > desc->acnt_ring_size) {
-			wiphy_err(hw->wiphy,
-				  "account size overflow (%d %d %d)\n",
-				  acnt_head, acnt_tail, read_size);
-			goto process_next;
+		rcu_read_unlock();
+		break;
+	case ACNT_CODE_TX_FLUSH:
+	case ACNT_CODE_TX_RESET:
+		pcie_aql_expire(hw, true);
+		break;
+	case ACNT_CODE_RX_PPDU:
+		acnt_rx = (struct acnt_rx_s *)acnt;
+		nf_a = (le32_to_cpu(acnt_rx->rx_info.nf_a_b) >>
+			RXINFO_NF_A_SHIFT) & RXINFO_NF_A_MASK;
+		nf_b = (le32_to_cpu(acnt_rx->rx_info.nf_a_b) >>
+			RXINFO_NF_B_SHIFT) & RXINFO_NF_B_MASK;
+		nf_c = (le32_to_cpu(acnt_rx->rx_info.nf_c_d) >>
+			RXINFO_NF_C_SHIFT) & RXINFO_NF_C_MASK;
+		nf_d = (le32_to_cpu(acnt_rx->rx_info.nf_c_d) >>
+			RXINFO_NF_D_SHIFT) & RXINFO_NF_D_MASK;
+		if ((nf_a >= 2048) && (nf_b >= 2048) &&
+		    (nf_c >= 2048) && (nf_d >= 2048)) {
+			nf_a = ((4096 - nf_a) >> 4);
+			nf_b = ((4096 - nf_b) >> 4);
+			nf_c = ((4096 - nf_c) >> 4);
+			nf_d = ((4096 - nf_d) >> 4);
+			priv->noise =
+				-((nf_a + nf_b + nf_c + nf_d) / 4);
 		}
-		acnt_recds = desc->pacnt_ring + acnt_tail;
-	}
-
-	pstart = acnt_recds;
-	pend = pstart + read_size;
-	while (pstart < pend) {
-		acnt = (struct acnt_s *)pstart;
-
-		switch (le16_to_cpu(acnt->code)) {
-		case ACNT_CODE_BUSY:
-			pcie_priv->acnt_busy++;
-			break;
-		case ACNT_CODE_WRAP:
-			pcie_priv->acnt_wrap++;
-			break;
-		case ACNT_CODE_DROP:
-			pcie_priv->acnt_drop++;
-			break;
-		case ACNT_CODE_TX_ENQUEUE:
-			acnt_tx = (struct acnt_tx_s *)pstart;
-			sta_info = utils_find_sta(priv, acnt_tx->hdr.wh.addr1);
+		dma_data = (struct pcie_dma_data *)
+			&acnt_rx->rx_info.hdr[0];
+		rcu_read_lock();
+		sta_info = utils_find_sta(priv, dma_data->wh.addr2);
+		if (sta_info) {
+			spin_lock_bh(&priv->sta_lock);
+			pcie_rx_account(priv, sta_info, acnt_rx);
+			spin_unlock_bh(&priv->sta_lock);
+			pcie_report_airtime(sta_info,
+				pcie_rx_account_tid(acnt_rx), 0,
+				le16_to_cpu(acnt_rx->air_time));
+		}
+		rcu_read_unlock();
+		break;
+	case ACNT_CODE_RA_STATS:
+		acnt_ra = (struct acnt_ra_s *)acnt;
+		stnid = le16_to_cpu(acnt_ra->stn_id);
+		if ((stnid > 0) && (stnid <= priv->stnid_num)) {
+			type = acnt_ra->type;
+			if (type < 2) {
+				if (acnt_ra->tx_attempt_cnt >= 250)
+					priv->ra_tx_attempt[type][5]++;
+				else if (acnt_ra->tx_attempt_cnt >= 100)
+					priv->ra_tx_attempt[type][4]++;
+				else if (acnt_ra->tx_attempt_cnt >= 50)
+					priv->ra_tx_attempt[type][3]++;
+				else if (acnt_ra->tx_attempt_cnt >= 15)
+					priv->ra_tx_attempt[type][2]++;
+				else if (acnt_ra->tx_attempt_cnt >= 4)
+					priv->ra_tx_attempt[type][1]++;
+				else
+					priv->ra_tx_attempt[type][0]++;
+			}
+			rcu_read_lock();
+			sta_info = utils_find_sta_by_id(priv, stnid);
 			if (sta_info) {
 				spin_lock_bh(&priv->sta_lock);
-				pcie_tx_account(priv, sta_info, acnt_tx);
+				pcie_tx_per(priv, sta_info, acnt_ra);
 				spin_unlock_bh(&priv->sta_lock);
 			}
-			break;
-		case ACNT_CODE_RX_PPDU:
-			acnt_rx = (struct acnt_rx_s *)pstart;
-			nf_a = (le32_to_cpu(acnt_rx->rx_info.nf_a_b) >>
-				RXINFO_NF_A_SHIFT) & RXINFO_NF_A_MASK;
-			nf_b = (le32_to_cpu(acnt_rx->rx_info.nf_a_b) >>
-				RXINFO_NF_B_SHIFT) & RXINFO_NF_B_MASK;
-			nf_c = (le32_to_cpu(acnt_rx->rx_info.nf_c_d) >>
-				RXINFO_NF_C_SHIFT) & RXINFO_NF_C_MASK;
-			nf_d = (le32_to_cpu(acnt_rx->rx_info.nf_c_d) >>
-				RXINFO_NF_D_SHIFT) & RXINFO_NF_D_MASK;
-			if ((nf_a >= 2048) && (nf_b >= 2048) &&
-			    (nf_c >= 2048) && (nf_d >= 2048)) {
-				nf_a = ((4096 - nf_a) >> 4);
-				nf_b = ((4096 - nf_b) >> 4);
-				nf_c = ((4096 - nf_c) >> 4);
-				nf_d = ((4096 - nf_d) >> 4);
-				priv->noise =
-					-((nf_a + nf_b + nf_c + nf_d) / 4);
+			rcu_read_unlock();
+		}
+		break;
+	case ACNT_CODE_BA_STATS:
+		acnt_ba = (struct acnt_ba_s *)acnt;
+		if (priv->ba_aid) {
+			rcu_read_lock();
+			sta_info = utils_find_sta_by_id(priv,
+				le16_to_cpu(acnt_ba->stnid));
+			if (sta_info) {
+				sta = container_of((void *)sta_info,
+						   struct ieee80211_sta,
+						   drv_priv);
+				if (sta->aid != priv->ba_aid)
+					sta_info = NULL;
 			}
-			dma_data = (struct pcie_dma_data *)
-				&acnt_rx->rx_info.hdr[0];
-			sta_info = utils_find_sta(priv, dma_data->wh.addr2);
 			if (sta_info) {
 				spin_lock_bh(&priv->sta_lock);
-				pcie_rx_account(priv, sta_info, acnt_rx);
+				pcie_ba_account(priv, sta_info,
+						acnt_ba);
 				spin_unlock_bh(&priv->sta_lock);
 			}
+			rcu_read_unlock();
+		}
+		break;
+	case ACNT_CODE_BF_MIMO_CTRL:
+		/* logging opens a file, leave it to the account work */
+		if ((acnt->len * 4 < sizeof(struct acnt_bf_mimo_ctrl_s)) ||
+		    (kfifo_avail(&pcie_priv->acnt_bf_fifo) <
+		     sizeof(struct acnt_bf_mimo_ctrl_s))) {
+			pcie_priv->acnt_bf_drop++;
 			break;
-		case ACNT_CODE_RA_STATS:
-			acnt_ra = (struct acnt_ra_s *)pstart;
-			stnid = le16_to_cpu(acnt_ra->stn_id);
-			if ((stnid > 0) && (stnid <= priv->stnid_num)) {
-				type = acnt_ra->type;
-				if (type < 2) {
-					if (acnt_ra->tx_attempt_cnt >= 250)
-						priv->ra_tx_attempt[type][5]++;
-					else if (acnt_ra->tx_attempt_cnt >= 100)
-						priv->ra_tx_attempt[type][4]++;
-					else if (acnt_ra->tx_attempt_cnt >= 50)
-						priv->ra_tx_attempt[type][3]++;
-					else if (acnt_ra->tx_attempt_cnt >= 15)
-						priv->ra_tx_attempt[type][2]++;
-					else if (acnt_ra->tx_attempt_cnt >= 4)
-						priv->ra_tx_attempt[type][1]++;
-					else
-						priv->ra_tx_attempt[type][0]++;
-				}
-				sta_info = utils_find_sta_by_id(priv, stnid);
-				if (sta_info) {
-					spin_lock_bh(&priv->sta_lock);
-					pcie_tx_per(priv, sta_info, acnt_ra);
-					spin_unlock_bh(&priv->sta_lock);
-				}
-			}
-			break;
-		case ACNT_CODE_BA_STATS:
-			acnt_ba = (struct acnt_ba_s *)pstart;
-			if (priv->ba_aid) {
-				sta_info = utils_find_sta_by_aid(priv,
-								 priv->ba_aid);
-				if (sta_info) {
-					spin_lock_bh(&priv->sta_lock);
-					pcie_ba_account(priv, sta_info,
-							acnt_ba);
-					spin_unlock_bh(&priv->sta_lock);
-				}
-			}
-			break;
-		case ACNT_CODE_BF_MIMO_CTRL:
-			acnt_bf_mimo_ctrl =
-				(struct acnt_bf_mimo_ctrl_s *)pstart;
-			pcie_bf_mimo_ctrl_decode(priv, acnt_bf_mimo_ctrl);
-			break;
-		default:
+		}
+		kfifo_in(&pcie_priv->acnt_bf_fifo, acnt,
+			 sizeof(struct acnt_bf_mimo_ctrl_s));
+		ieee80211_queue_work(hw, &priv->account_handle);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Records are read in place; one that wraps around the end of the ring is
+ * copied to pacnt_buf first.
+ */
+static void *pcie_account_peek(struct pcie_desc_data_ndp *desc,
+			       u32 offset, u32 len)
+{
+	u32 first;
+
+	if (offset + len <= desc->acnt_ring_size)
+		return desc->pacnt_ring + offset;
+
+	first = desc->acnt_ring_size - offset;
+	memcpy(desc->pacnt_buf, desc->pacnt_ring + offset, first);
+	memcpy(desc->pacnt_buf + first, desc->pacnt_ring, len - first);
+
+	return desc->pacnt_buf;
+}
+
+static int pcie_account_poll_napi_ndp(struct napi_struct *napi, int budget)
+{
+	struct pcie_priv *pcie_priv =
+		container_of(napi, struct pcie_priv, acnt_napi);
+	struct mwl_priv *priv = pcie_priv->mwl_priv;
+	struct ieee80211_hw *hw = priv->hw;
+	struct pcie_desc_data_ndp *desc = &pcie_priv->desc_data_ndp;
+	u32 acnt_head, acnt_tail;
+	u32 read_size, len;
+	struct acnt_s *acnt;
+	int done = 0;
+
+	pcie_priv->acnt_polls++;
+	acnt_head = readl(pcie_priv->iobase1 + MACREG_REG_ACNTHEAD);
+	acnt_tail = readl(pcie_priv->iobase1 + MACREG_REG_ACNTTAIL);
+
+	if (acnt_tail > acnt_head)
+		read_size = desc->acnt_ring_size - acnt_tail + acnt_head;
+	else
+		read_size = acnt_head - acnt_tail;
+	if ((read_size > desc->acnt_ring_size) ||
+	    (acnt_tail >= desc->acnt_ring_size)) {
+		wiphy_err(hw->wiphy, "account size overflow (%d %d %d)\n",
+			  acnt_head, acnt_tail, read_size);
+		acnt_tail = acnt_head;
+		goto out;
+	}
+
+	while (read_size && (done < budget)) {
+		acnt = pcie_account_peek(desc, acnt_tail,
+					 offsetof(struct acnt_s, tsf));
+		len = acnt->len * 4;
+		if (!len || (len > read_size)) {
+			/* lost sync with firmware, skip to the head */
+			acnt_tail = acnt_head;
 			break;
 		}
 
-		if (acnt->len)
-			pstart += acnt->len * 4;
-		else
-			goto process_next;
+		acnt = pcie_account_peek(desc, acnt_tail, len);
+		pcie_account_record(hw, acnt);
+
+		acnt_tail += len;
+		if (acnt_tail >= desc->acnt_ring_size)
+			acnt_tail -= desc->acnt_ring_size;
+		read_size -= len;
+		done++;
 	}
-process_next:
-	acnt_tail = acnt_head;
+
+out:
 	writel(acnt_tail, pcie_priv->iobase1 + MACREG_REG_ACNTTAIL);
+
+	if (pcie_priv->aql && done)
+		pcie_aql_kick(pcie_priv);
+
+	if (done >= budget) {
+		pcie_priv->acnt_budget_hits++;
+		return budget;
+	}
+
+	if (napi_complete_done(napi, done))
+		pcie_mask_int(pcie_priv, MACREG_A2HRIC_ACNT_HEAD_RDY, true);
+
+	return done;
+}
+
+/* Runs from account_handle for the records too slow for the NAPI poll. */
+static void pcie_process_account(struct ieee80211_hw *hw)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct pcie_priv *pcie_priv = priv->hif.priv;
+	struct acnt_bf_mimo_ctrl_s bf_mimo_ctrl;
+
+	while (kfifo_out(&pcie_priv->acnt_bf_fifo, &bf_mimo_ctrl,
+			 sizeof(bf_mimo_ctrl)) == sizeof(bf_mimo_ctrl))
+		pcie_bf_mimo_ctrl_decode(priv, &bf_mimo_ctrl);
 }
 
 static int pcie_mcast_cts(struct ieee80211_hw *hw, bool enable)
@@ -1649,6 +2232,7 @@ static const struct mwl_hif_ops pcie_hif_ops_ndp = {
 	.download_firmware     = pcie_download_firmware,
 	.timer_routine         = pcie_timer_routine_ndp,
 	.tx_xmit               = pcie_tx_xmit_ndp,
+	.tx_wake_queue         = pcie_tx_wake_queue_ndp,
 	.tx_return_pkts        = pcie_tx_return_pkts_ndp,
 	.get_device_node       = pcie_get_device_node,
 	.get_survey            = pcie_get_survey,
@@ -1692,6 +2276,20 @@ static int pcie_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 
 	pci_set_master(pdev);
 
+	/* The A2H cause register is the only interrupt source, so a single
+	 * vector is all the device can use. MSI still gets the radio its own
+	 * vector, and with it its own CPU affinity.
+	 */
+	rc = pci_alloc_irq_vectors(pdev, 1, 1, msi ?
+				   (PCI_IRQ_MSI | PCI_IRQ_INTX) : PCI_IRQ_INTX);
+	if (rc < 0) {
+		pr_err("%s: cannot allocate interrupt vector\n",
+		       PCIE_DRV_NAME);
+		goto err_pci_disable_device;
+	}
+	pr_info("%s: using %s interrupt\n", PCIE_DRV_NAME,
+		pdev->msi_enabled ? "MSI" : "INTx");
+
 	if (id->driver_data == MWL8964)
 		hif_ops = &pcie_hif_ops_ndp;
 	else if (id->driver_data == MWL8997)
@@ -1705,7 +2303,7 @@ static int pcie_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 		pr_err("%s: mwlwifi hw alloc failed\n",
 		       PCIE_DRV_NAME);
 		rc = -ENOMEM;
-		goto err_pci_disable_device;
+		goto err_free_irq_vectors;
 	}
 
 	pci_set_drvdata(pdev, hw);
@@ -1726,6 +2324,7 @@ static int pcie_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 			rate_adapt_mode, dwds_stamode, optimization_level, dump_hostcmd, feature);
 
 	pcie_priv->pdev = pdev;
+	init_completion(&pcie_priv->cmd_done);
 	if (id->driver_data != MWL8964) {
 		pcie_priv->tx_head_room = PCIE_MIN_BYTES_HEADROOM;
 		if (id->driver_data == MWL8997) {
@@ -1761,6 +2360,10 @@ err_alloc_pci_resource:
 	pci_set_drvdata(pdev, NULL);
 	mwl_free_hw(hw);
 
+err_free_irq_vectors:
+
+	pci_free_irq_vectors(pdev);
+
 err_pci_disable_device:
 
 	pci_disable_device(pdev);
@@ -1780,6 +2383,7 @@ static void pcie_remove(struct pci_dev *pdev)
 	mwl_deinit_hw(hw);
 	pci_set_drvdata(pdev, NULL);
 	mwl_free_hw(hw);
+	pci_free_irq_vectors(pdev);
 	pci_disable_device(pdev);
 }
 
@@ -1800,6 +2404,14 @@ module_param(dump_hostcmd, bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 MODULE_PARM_DESC(dump_hostcmd, "dump_hostcmd");
 module_param(feature, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 MODULE_PARM_DESC(feature, "set feature hw");
+module_param(tx_burst, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(tx_burst, "max frames per 88W8964 TX doorbell");
+module_param(msi, bool, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(msi, "use MSI when available, INTx otherwise");
+module_param(threaded, bool, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(threaded, "run RX NAPI and TX in per-radio kernel threads");
+module_param(aql, bool, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(aql, "limit 88W8964 TX queueing by firmware reported airtime");
 
 module_pci_driver(mwl_pcie_driver);
 
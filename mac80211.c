@@ -103,6 +103,18 @@ static void mwl_mac80211_tx(struct ieee80211_hw *hw,
 	mwl_hif_tx_xmit(hw, control, skb);
 }
 
+static void mwl_mac80211_wake_tx_queue(struct ieee80211_hw *hw,
+				       struct ieee80211_txq *txq)
+{
+	struct mwl_priv *priv = hw->priv;
+
+	/* Frames stay in mac80211 intermediate queues until radio is on. */
+	if (!priv->radio_on)
+		return;
+
+	mwl_hif_tx_wake_queue(hw, txq);
+}
+
 static int mwl_mac80211_start(struct ieee80211_hw *hw)
 {
 	struct mwl_priv *priv = hw->priv;
@@ -175,6 +187,19 @@ static void mwl_mac80211_stop(struct ieee80211_hw *hw)
 	mwl_hif_tx_return_pkts(hw);
 }
 
+/* Only the 88W8964 new data path exchanges 802.3 frames; it converts them
+ * to and from its DA/SA descriptor format without an 802.11 header.
+ */
+static void mwl_mac80211_vif_offload(struct mwl_priv *priv,
+				     struct ieee80211_vif *vif)
+{
+	if ((priv->chip_type != MWL8964) ||
+	    ((vif->type != NL80211_IFTYPE_AP) &&
+	    (vif->type != NL80211_IFTYPE_STATION)))
+		vif->offload_flags &= ~(IEEE80211_OFFLOAD_ENCAP_ENABLED |
+					IEEE80211_OFFLOAD_DECAP_ENABLED);
+}
+
 static int mwl_mac80211_add_interface(struct ieee80211_hw *hw,
 				      struct ieee80211_vif *vif)
 {
@@ -245,9 +270,11 @@ static int mwl_mac80211_add_interface(struct ieee80211_hw *hw,
 		return -EINVAL;
 	}
 
+	mwl_mac80211_vif_offload(priv, vif);
+
 	priv->macids_used |= 1 << mwl_vif->macid;
 	spin_lock_bh(&priv->vif_lock);
-	list_add_tail(&mwl_vif->list, &priv->vif_list);
+	list_add_tail_rcu(&mwl_vif->list, &priv->vif_list);
 	spin_unlock_bh(&priv->vif_lock);
 
 	return 0;
@@ -265,15 +292,15 @@ static void mwl_mac80211_remove_vif(struct mwl_priv *priv,
 	if (vif->type == NL80211_IFTYPE_MONITOR) {
 		int counter = 0;
 		struct ieee80211_vif *_vif;
-		spin_lock_bh(&priv->vif_lock);
-		list_for_each_entry(mwl_vif, &priv->vif_list, list) {
+		rcu_read_lock();
+		list_for_each_entry_rcu(mwl_vif, &priv->vif_list, list) {
 			_vif = container_of((void *)mwl_vif, struct ieee80211_vif,
 					drv_priv);
 
 			if (_vif->type == NL80211_IFTYPE_MONITOR)
 				counter++;
 		}
-		spin_unlock_bh(&priv->vif_lock);
+		rcu_read_unlock();
 		/* but if existe more than 1,
 		   so 1 interface is still activ*/
 		if (counter <= 1)
@@ -284,8 +311,10 @@ static void mwl_mac80211_remove_vif(struct mwl_priv *priv,
 
 	priv->macids_used &= ~(1 << mwl_vif->macid);
 	spin_lock_bh(&priv->vif_lock);
-	list_del(&mwl_vif->list);
+	list_del_rcu(&mwl_vif->list);
 	spin_unlock_bh(&priv->vif_lock);
+	/* RX may still hold it from utils_find_vif_bss() */
+	synchronize_rcu();
 }
 
 static void mwl_mac80211_remove_interface(struct ieee80211_hw *hw,
@@ -308,6 +337,76 @@ static void mwl_mac80211_remove_interface(struct ieee80211_hw *hw,
 	mwl_mac80211_remove_vif(priv, vif);
 }
 
+static void mwl_mac80211_update_vif_offload(struct ieee80211_hw *hw,
+					    struct ieee80211_vif *vif)
+{
+	struct mwl_priv *priv = hw->priv;
+
+	mwl_mac80211_vif_offload(priv, vif);
+}
+
+static void mwl_mac80211_sta_set_decap_offload(struct ieee80211_hw *hw,
+					       struct ieee80211_vif *vif,
+					       struct ieee80211_sta *sta,
+					       bool enabled)
+{
+	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
+
+	sta_info->rx_decap = enabled;
+}
+
+/* Everything firmware needs for a new operating channel. Settings and
+ * power levels that did not change are skipped by the fwcmd shadow state;
+ * the time each switch takes is kept for the chan_switch debugfs file.
+ */
+static int mwl_mac80211_switch_channel(struct ieee80211_hw *hw,
+				       struct ieee80211_conf *conf)
+{
+	struct mwl_priv *priv = hw->priv;
+	struct mwl_chan_switch_stats *stats = &priv->chan_switch_stats;
+	ktime_t start = ktime_get();
+	int rate = 0;
+	u32 us;
+	int rc;
+
+	if (conf->chandef.chan->band == NL80211_BAND_2GHZ) {
+		mwl_fwcmd_set_apmode(hw, AP_MODE_2_4GHZ_11AC_MIXED);
+		mwl_fwcmd_set_linkadapt_cs_mode(hw, LINK_CS_STATE_CONSERV);
+		rate = mwl_rates_24[0].hw_value;
+	} else if (conf->chandef.chan->band == NL80211_BAND_5GHZ) {
+		mwl_fwcmd_set_apmode(hw, AP_MODE_11AC);
+		mwl_fwcmd_set_linkadapt_cs_mode(hw, LINK_CS_STATE_AUTO);
+		rate = mwl_rates_50[0].hw_value;
+
+		if (conf->radar_enabled)
+			mwl_fwcmd_set_radar_detect(hw, MONITOR_START);
+		else
+			mwl_fwcmd_set_radar_detect(hw, STOP_DETECT_RADAR);
+	}
+
+	rc = mwl_fwcmd_set_rf_channel(hw, conf);
+	if (rc)
+		return rc;
+	rc = mwl_fwcmd_use_fixed_rate(hw, rate, rate);
+	if (rc)
+		return rc;
+	rc = mwl_fwcmd_chan_tx_power(hw, conf, 0);
+	if (rc)
+		return rc;
+	rc = mwl_fwcmd_set_cdd(hw);
+	if (rc)
+		return rc;
+
+	us = ktime_us_delta(ktime_get(), start);
+	stats->cnt++;
+	stats->last_us = us;
+	if (us > stats->max_us)
+		stats->max_us = us;
+	stats->total_us += us;
+
+	return 0;
+}
+
 static int mwl_mac80211_config(struct ieee80211_hw *hw,
 			       u32 changed)
 {
@@ -324,41 +423,8 @@ static int mwl_mac80211_config(struct ieee80211_hw *hw,
 	if (rc)
 		goto out;
 
-	if (changed & IEEE80211_CONF_CHANGE_CHANNEL) {
-		int rate = 0;
-
-		if (conf->chandef.chan->band == NL80211_BAND_2GHZ) {
-			mwl_fwcmd_set_apmode(hw, AP_MODE_2_4GHZ_11AC_MIXED);
-			mwl_fwcmd_set_linkadapt_cs_mode(hw,
-							LINK_CS_STATE_CONSERV);
-			rate = mwl_rates_24[0].hw_value;
-		} else if (conf->chandef.chan->band == NL80211_BAND_5GHZ) {
-			mwl_fwcmd_set_apmode(hw, AP_MODE_11AC);
-			mwl_fwcmd_set_linkadapt_cs_mode(hw,
-							LINK_CS_STATE_AUTO);
-			rate = mwl_rates_50[0].hw_value;
-
-			if (conf->radar_enabled)
-				mwl_fwcmd_set_radar_detect(hw, MONITOR_START);
-			else
-				mwl_fwcmd_set_radar_detect(hw,
-							   STOP_DETECT_RADAR);
-		}
-
-		rc = mwl_fwcmd_set_rf_channel(hw, conf);
-		if (rc)
-			goto out;
-		rc = mwl_fwcmd_use_fixed_rate(hw, rate, rate);
-		if (rc)
-			goto out;
-		rc = mwl_fwcmd_max_tx_power(hw, conf, 0);
-		if (rc)
-			goto out;
-		rc = mwl_fwcmd_tx_power(hw, conf, 0);
-		if (rc)
-			goto out;
-		rc = mwl_fwcmd_set_cdd(hw);
-	}
+	if (changed & IEEE80211_CONF_CHANGE_CHANNEL)
+		rc = mwl_mac80211_switch_channel(hw, conf);
 
 out:
 
@@ -625,9 +691,11 @@ static int mwl_mac80211_sta_add(struct ieee80211_hw *hw,
 		sta_info->sta_stnid = sta_stnid;
 	sta_info->tx_rate_info = utils_get_init_tx_rate(priv, &hw->conf, sta);
 	spin_lock_init(&sta_info->amsdu_lock);
-	spin_lock_bh(&priv->sta_lock);
-	list_add_tail(&sta_info->list, &priv->sta_list);
-	spin_unlock_bh(&priv->sta_lock);
+	for (i = 0; i < SYSADPT_TX_WMM_QUEUES; i++) {
+		INIT_LIST_HEAD(&sta_info->amsdu_ctrl.frag[i].list);
+		sta_info->amsdu_ctrl.frag[i].sta_info = sta_info;
+	}
+	utils_add_sta(priv, sta);
 
 	if (vif->type == NL80211_IFTYPE_STATION)
 		mwl_fwcmd_set_new_stn_del(hw, vif, sta->addr);
@@ -683,13 +751,18 @@ static int mwl_mac80211_sta_remove(struct ieee80211_hw *hw,
 	if (vif->type == NL80211_IFTYPE_STATION)
 		utils_free_stnid(priv, sta_info->sta_stnid);
 
-	spin_lock_bh(&priv->sta_lock);
-	list_del(&sta_info->list);
-	spin_unlock_bh(&priv->sta_lock);
-
 	return rc;
 }
 
+static void mwl_mac80211_sta_pre_rcu_remove(struct ieee80211_hw *hw,
+					    struct ieee80211_vif *vif,
+					    struct ieee80211_sta *sta)
+{
+	struct mwl_priv *priv = hw->priv;
+
+	utils_del_sta(priv, sta);
+}
+
 static int mwl_mac80211_conf_tx(struct ieee80211_hw *hw,
 				struct ieee80211_vif *vif,
 				u16 queue,
@@ -790,10 +863,10 @@ static int mwl_mac80211_ampdu_action(struct ieee80211_hw *hw,
 			tmp.sta = sta;
 			tmp.tid = tid;
 			spin_unlock_bh(&priv->stream_lock);
-			mwl_fwcmd_create_ba(hw, &tmp, vif,
-					    BA_FLAG_DIRECTION_DOWN,
-					    buf_size, params->ssn,
-					    params->amsdu);
+			rc = mwl_fwcmd_create_ba(hw, &tmp, vif,
+						 BA_FLAG_DIRECTION_DOWN,
+						 buf_size, params->ssn,
+						 params->amsdu);
 			spin_lock_bh(&priv->stream_lock);
 		}
 		break;
@@ -836,7 +909,7 @@ static int mwl_mac80211_ampdu_action(struct ieee80211_hw *hw,
 				break;
 			}
 		}
-		stream->state = AMPDU_STREAM_IN_PROGRESS;
+		mwl_fwcmd_set_stream_state(stream, AMPDU_STREAM_IN_PROGRESS);
 		spin_unlock_bh(&priv->stream_lock);
 		rc = mwl_fwcmd_get_seqno(hw, stream, &params->ssn);
 		spin_lock_bh(&priv->stream_lock);
@@ -849,7 +922,8 @@ static int mwl_mac80211_ampdu_action(struct ieee80211_hw *hw,
 	case IEEE80211_AMPDU_TX_STOP_FLUSH_CONT:
 		if (stream) {
 			if (stream->state == AMPDU_STREAM_ACTIVE) {
-				stream->state = AMPDU_STREAM_IN_PROGRESS;
+				mwl_fwcmd_set_stream_state(stream,
+							   AMPDU_STREAM_IN_PROGRESS);
 				mwl_hif_tx_del_ampdu_pkts(hw, sta, stream->desc_num);
 				spin_unlock_bh(&priv->stream_lock);
 				mwl_fwcmd_destroy_ba(hw, stream,
@@ -886,7 +960,8 @@ static int mwl_mac80211_ampdu_action(struct ieee80211_hw *hw,
 					  rc);
 			} else {
 				spin_lock_bh(&priv->stream_lock);
-				stream->state = AMPDU_STREAM_ACTIVE;
+				mwl_fwcmd_set_stream_state(stream,
+							   AMPDU_STREAM_ACTIVE);
 				sta_info->check_ba_failed[tid] = 0;
 				if (priv->tx_amsdu)
 					sta_info->is_amsdu_allowed = params->amsdu;
@@ -938,10 +1013,12 @@ static void mwl_mac80211_sw_scan_complete(struct ieee80211_hw *hw,
 
 const struct ieee80211_ops mwl_mac80211_ops = {
 	.tx                 = mwl_mac80211_tx,
+	.wake_tx_queue      = mwl_mac80211_wake_tx_queue,
 	.start              = mwl_mac80211_start,
 	.stop               = mwl_mac80211_stop,
 	.add_interface      = mwl_mac80211_add_interface,
 	.remove_interface   = mwl_mac80211_remove_interface,
+	.update_vif_offload = mwl_mac80211_update_vif_offload,
 	.config             = mwl_mac80211_config,
 	.bss_info_changed   = mwl_mac80211_bss_info_changed,
 	.configure_filter   = mwl_mac80211_configure_filter,
@@ -949,6 +1026,8 @@ const struct ieee80211_ops mwl_mac80211_ops = {
 	.set_rts_threshold  = mwl_mac80211_set_rts_threshold,
 	.sta_add            = mwl_mac80211_sta_add,
 	.sta_remove         = mwl_mac80211_sta_remove,
+	.sta_pre_rcu_remove = mwl_mac80211_sta_pre_rcu_remove,
+	.sta_set_decap_offload = mwl_mac80211_sta_set_decap_offload,
 	.conf_tx            = mwl_mac80211_conf_tx,
 	.get_stats          = mwl_mac80211_get_stats,
 	.get_survey         = mwl_mac80211_get_survey,
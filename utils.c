@@ -16,6 +16,12 @@
 /* Description:  This file implements common utility functions. */
 
 #include <linux/etherdevice.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,12,0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
 
 #include "sysadpt.h"
 #include "core.h"
@@ -238,37 +244,71 @@ u32 utils_get_init_tx_rate(struct mwl_priv *priv, struct ieee80211_conf *conf,
 	return tx_rate;
 }
 
+/* Called under rcu_read_lock(), like the station lookups below. */
 struct mwl_vif *utils_find_vif_bss(struct mwl_priv *priv, u8 *bssid)
 {
 	struct mwl_vif *mwl_vif;
 
-	spin_lock_bh(&priv->vif_lock);
-	list_for_each_entry(mwl_vif, &priv->vif_list, list) {
-		if (ether_addr_equal(bssid, mwl_vif->bssid)) {
-			spin_unlock_bh(&priv->vif_lock);
+	list_for_each_entry_rcu(mwl_vif, &priv->vif_list, list) {
+		if (ether_addr_equal(bssid, mwl_vif->bssid))
 			return mwl_vif;
-		}
 	}
-	spin_unlock_bh(&priv->vif_lock);
 
 	return NULL;
 }
 
+static inline u32 utils_sta_hash_key(const u8 *addr)
+{
+	/* the OUI carries little entropy, hash the low four bytes */
+	return get_unaligned_le32(addr + 2);
+}
+
+void utils_add_sta(struct mwl_priv *priv, struct ieee80211_sta *sta)
+{
+	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
+
+	spin_lock_bh(&priv->sta_lock);
+	list_add_tail_rcu(&sta_info->list, &priv->sta_list);
+	hash_add_rcu(priv->sta_hash, &sta_info->hash,
+		     utils_sta_hash_key(sta->addr));
+	if (sta_info->stnid && (sta_info->stnid <= priv->stnid_num))
+		rcu_assign_pointer(priv->sta_by_id[sta_info->stnid], sta_info);
+	spin_unlock_bh(&priv->sta_lock);
+}
+
+/* Called from sta_pre_rcu_remove; mac80211 waits for a grace period
+ * before sta_remove and before it frees the station, so readers inside
+ * rcu_read_lock() are done with it by then.
+ */
+void utils_del_sta(struct mwl_priv *priv, struct ieee80211_sta *sta)
+{
+	struct mwl_sta *sta_info = mwl_dev_get_sta(sta);
+	u16 stnid = sta_info->stnid;
+
+	spin_lock_bh(&priv->sta_lock);
+	list_del_rcu(&sta_info->list);
+	hash_del_rcu(&sta_info->hash);
+	if (stnid && (stnid <= priv->stnid_num) &&
+	    (rcu_access_pointer(priv->sta_by_id[stnid]) == sta_info))
+		RCU_INIT_POINTER(priv->sta_by_id[stnid], NULL);
+	spin_unlock_bh(&priv->sta_lock);
+}
+
+/* The lookups below must be called under rcu_read_lock(), and the
+ * returned station is only valid until rcu_read_unlock().
+ */
 struct mwl_sta *utils_find_sta(struct mwl_priv *priv, u8 *addr)
 {
 	struct mwl_sta *sta_info;
 	struct ieee80211_sta *sta;
 
-	spin_lock_bh(&priv->sta_lock);
-	list_for_each_entry(sta_info, &priv->sta_list, list) {
+	hash_for_each_possible_rcu(priv->sta_hash, sta_info, hash,
+				   utils_sta_hash_key(addr)) {
 		sta = container_of((void *)sta_info, struct ieee80211_sta,
 				   drv_priv);
-		if (ether_addr_equal(addr, sta->addr)) {
-			spin_unlock_bh(&priv->sta_lock);
+		if (ether_addr_equal(addr, sta->addr))
 			return sta_info;
-		}
 	}
-	spin_unlock_bh(&priv->sta_lock);
 
 	return NULL;
 }
@@ -277,35 +317,131 @@ struct mwl_sta *utils_find_sta_by_aid(struct mwl_priv *priv, u16 aid)
 {
 	struct mwl_sta *sta_info;
 	struct ieee80211_sta *sta;
+	int bkt;
 
-	spin_lock_bh(&priv->sta_lock);
-	list_for_each_entry(sta_info, &priv->sta_list, list) {
+	hash_for_each_rcu(priv->sta_hash, bkt, sta_info, hash) {
 		sta = container_of((void *)sta_info, struct ieee80211_sta,
 				   drv_priv);
-		if (sta->aid == aid) {
-			spin_unlock_bh(&priv->sta_lock);
+		if (sta->aid == aid)
 			return sta_info;
-		}
 	}
-	spin_unlock_bh(&priv->sta_lock);
 
 	return NULL;
 }
 
 struct mwl_sta *utils_find_sta_by_id(struct mwl_priv *priv, u16 stnid)
 {
-	struct mwl_sta *sta_info;
+	if (!stnid || (stnid > priv->stnid_num))
+		return NULL;
 
-	spin_lock_bh(&priv->sta_lock);
-	list_for_each_entry(sta_info, &priv->sta_list, list) {
-		if (sta_info->stnid == stnid) {
-			spin_unlock_bh(&priv->sta_lock);
-			return sta_info;
+	return rcu_dereference(priv->sta_by_id[stnid]);
+}
+
+/* Station ids come from a bitmap.  A macid may own a reserved range, which
+ * it uses first; everyone else allocates from the ids nobody reserved,
+ * rotating through them so a roaming station does not immediately get the
+ * id of the one that just left.
+ */
+int utils_assign_stnid(struct mwl_priv *priv, int macid, u16 aid)
+{
+	struct mwl_stnid_range *range = NULL;
+	unsigned int bit, end;
+
+	spin_lock_bh(&priv->stnid_lock);
+
+	if ((macid >= 0) && (macid < MWL_MACID_NUM))
+		range = &priv->stnid_range[macid];
+
+	if (range && range->num) {
+		end = range->start - 1 + range->num;
+		bit = find_next_zero_bit(priv->stnid_map, end,
+					 range->start - 1);
+		if (bit < end)
+			goto found;
+	}
+
+	bit = find_next_zero_bit(priv->stnid_busy, priv->stnid_num,
+				 priv->stnid_next);
+	if (bit >= priv->stnid_num)
+		bit = find_first_zero_bit(priv->stnid_busy, priv->stnid_num);
+	if (bit >= priv->stnid_num) {
+		spin_unlock_bh(&priv->stnid_lock);
+		return 0;
+	}
+	priv->stnid_next = (bit + 1 < priv->stnid_num) ? bit + 1 : 0;
+
+found:
+	__set_bit(bit, priv->stnid_map);
+	__set_bit(bit, priv->stnid_busy);
+	priv->stnid[bit].macid = macid;
+	priv->stnid[bit].aid = aid;
+	priv->stnid_used++;
+	spin_unlock_bh(&priv->stnid_lock);
+
+	return bit + 1;
+}
+
+void utils_free_stnid(struct mwl_priv *priv, u16 stnid)
+{
+	unsigned int bit = stnid - 1;
+
+	spin_lock_bh(&priv->stnid_lock);
+	if (stnid && (stnid <= priv->stnid_num) &&
+	    __test_and_clear_bit(bit, priv->stnid_map)) {
+		if (!test_bit(bit, priv->stnid_reserved))
+			__clear_bit(bit, priv->stnid_busy);
+		priv->stnid[bit].macid = 0;
+		priv->stnid[bit].aid = 0;
+		priv->stnid_used--;
+	}
+	spin_unlock_bh(&priv->stnid_lock);
+}
+
+/* Reserve stnids [start, start + num) for macid, replacing any range it
+ * held before; num 0 just drops the reservation.  Ids already assigned in
+ * the range stay with their station until it is removed.
+ */
+int utils_reserve_stnid(struct mwl_priv *priv, int macid, u16 start, u16 num)
+{
+	struct mwl_stnid_range *range;
+	unsigned int end = start - 1 + num;
+	int rc = 0;
+
+	if ((macid < 0) || (macid >= MWL_MACID_NUM))
+		return -EINVAL;
+
+	if (num && (!start || (end > priv->stnid_num)))
+		return -EINVAL;
+
+	spin_lock_bh(&priv->stnid_lock);
+	range = &priv->stnid_range[macid];
+
+	if (range->num)
+		bitmap_clear(priv->stnid_reserved, range->start - 1,
+			     range->num);
+
+	if (num) {
+		if (find_next_bit(priv->stnid_reserved, end,
+				  start - 1) < end) {
+			/* put the old reservation back */
+			if (range->num)
+				bitmap_set(priv->stnid_reserved,
+					   range->start - 1, range->num);
+			rc = -EBUSY;
+			goto out;
 		}
+		bitmap_set(priv->stnid_reserved, start - 1, num);
 	}
-	spin_unlock_bh(&priv->sta_lock);
 
-	return NULL;
+	range->start = num ? start : 0;
+	range->num = num;
+
+out:
+	bitmap_or(priv->stnid_busy, priv->stnid_map, priv->stnid_reserved,
+		  priv->stnid_num);
+	spin_unlock_bh(&priv->stnid_lock);
+
+	return rc;
 }
 
 void utils_dump_data_info(const char *prefix_str, const void *buf, size_t len)
@@ -67,41 +67,11 @@ static inline int utils_tid_to_ac(u8 tid)
 	return -1;
 }
 
-static inline int utils_assign_stnid(struct mwl_priv *priv, int macid, u16 aid)
-{
-	int stnid;
-	int i;
-
-	spin_lock_bh(&priv->stnid_lock);
-	stnid = priv->available_stnid;
-	if (stnid >= priv->stnid_num) {
-		spin_unlock_bh(&priv->stnid_lock);
-		return 0;
-	}
-	priv->stnid[stnid].macid = macid;
-	priv->stnid[stnid].aid = aid;
-	stnid++;
-	for (i = stnid; i < priv->stnid_num; i++) {
-		if (!priv->stnid[i].aid)
-			break;
-	}
-	priv->available_stnid = i;
-	spin_unlock_bh(&priv->stnid_lock);
-	return stnid;
-}
+int utils_assign_stnid(struct mwl_priv *priv, int macid, u16 aid);
 
-static inline void utils_free_stnid(struct mwl_priv *priv, u16 stnid)
-{
-	spin_lock_bh(&priv->stnid_lock);
-	if (stnid && (stnid <= priv->stnid_num)) {
-		stnid--;
-		priv->stnid[stnid].macid = 0;
-		priv->stnid[stnid].aid = 0;
-		if (priv->available_stnid > stnid)
-			priv->available_stnid = stnid;
-	}
-	spin_unlock_bh(&priv->stnid_lock);
-}
+void utils_free_stnid(struct mwl_priv *priv, u16 stnid);
+
+int utils_reserve_stnid(struct mwl_priv *priv, int macid, u16 start, u16 num);
 
 int utils_get_phy_rate(u8 format, u8 bandwidth, u8 short_gi, u8 mcs_id);
 
@@ -112,6 +82,10 @@ u32 utils_get_init_tx_rate(struct mwl_priv *priv, struct ieee80211_conf *conf,
 
 struct mwl_vif *utils_find_vif_bss(struct mwl_priv *priv, u8 *bssid);
 
+void utils_add_sta(struct mwl_priv *priv, struct ieee80211_sta *sta);
+
+void utils_del_sta(struct mwl_priv *priv, struct ieee80211_sta *sta);
+
 struct mwl_sta *utils_find_sta(struct mwl_priv *priv, u8 *addr);
 
 struct mwl_sta *utils_find_sta_by_aid(struct mwl_priv *priv, u16 aid);